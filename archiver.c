@@ -1,493 +1,2357 @@
-#include <time.h>
-#include <stdint.h>
-#include <unistd.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include "archiver.h"
-#include "file_processing.h"
-#include "huffman_tree.h"
-#include "huffman_coding.h"
-
-//print message & error
-
-void print_msg(const char *msg, ...) {
-    va_list argptr;
-    va_start(argptr, msg);
-    vfprintf(stdout, msg, argptr);
-    va_end(argptr);
-}
-
-void print_error(const char *msg, ...) {
-    va_list argptr;
-    va_start(argptr, msg);
-    vfprintf(stderr, msg, argptr);
-    va_end(argptr);
-}
-
-//file signature
-
-const char magic_num[] = "MAGIC_NUMBER";
-
-//archive positions
-
-#define MAGIC_NUM_FILEPOS   0
-#define CHECKSUM_FILEPOS    (MAGIC_NUM_FILEPOS + sizeof(magic_num) - 1)
-#define FILE_NUM_FILEPOS    (CHECKSUM_FILEPOS + sizeof(uint32_t))
-#define FILE_INFO_FILEPOS   (FILE_NUM_FILEPOS + sizeof(int))
-
-//read file signature & checksum & number of files
-
-int check_magic_num(FILE *arch) {
-    file_set_pos(arch, MAGIC_NUM_FILEPOS);
-    static char buf[sizeof(magic_num)] = {0};
-    fread(buf, sizeof(magic_num) - 1, 1, arch);
-    rewind(arch);
-    return !strcmp(magic_num, buf);
-}
-
-uint32_t read_checksum(FILE *arch) {
-    file_set_pos(arch, CHECKSUM_FILEPOS);
-    uint32_t checksum = 0;
-    fread(&checksum, sizeof(uint32_t), 1, arch);
-    return checksum;
-}
-
-unsigned read_num_of_files(FILE *arch) {
-    file_set_pos(arch, FILE_NUM_FILEPOS);
-    unsigned file_num = 0;
-    fread(&file_num, sizeof(int), 1, arch);
-    return file_num;
-}
-
-//write info to the header
-
-void write_magic_number(FILE *arch) {
-    file_set_pos(arch, MAGIC_NUM_FILEPOS);
-    fwrite(magic_num, sizeof(magic_num) - 1, 1, arch);
-}
-
-void write_checksum(FILE *arch, uint32_t checksum) {
-    file_set_pos(arch, CHECKSUM_FILEPOS);
-    fwrite(&checksum, sizeof(uint32_t), 1, arch);
-}
-
-void write_num_of_files(FILE *arch, unsigned file_num) {
-    file_set_pos(arch, FILE_NUM_FILEPOS);
-    fwrite(&file_num, sizeof(int), 1, arch);
-}
-
-void refresh_checksum(FILE *arch) {
-    //set the position right after the checksum
-    file_set_pos(arch, FILE_NUM_FILEPOS);
-    //count & write the checksum to the header
-    write_checksum(arch, get_checksum(arch));
-}
-
-void write_file_info(FILE *arch, char *file_name, unsigned file_size, unsigned comp_size, time_t add_time) {
-    unsigned char name_size = strlen(file_name) + 1;
-    fwrite(&name_size, sizeof(char), 1, arch);
-    fwrite(file_name, sizeof(char), name_size, arch);
-    fwrite(&file_size, sizeof(int), 1, arch);
-    fwrite(&comp_size, sizeof(int), 1, arch);
-    fwrite(&add_time, sizeof(time_t), 1, arch);
-}
-
-//archive header
-
-typedef struct Header {
-    char file_signature[sizeof(magic_num)];
-    uint32_t checksum;
-    unsigned file_num;
-    char **file_name;
-    unsigned *file_size;
-    unsigned *comp_size;
-    time_t *add_time;
-} Header;
-
-Header *read_header(FILE *arch) {
-    Header *file_header = (Header*)calloc(1, sizeof(Header));
-    file_set_pos(arch, MAGIC_NUM_FILEPOS);
-    //magic number
-    fread(file_header->file_signature, sizeof(magic_num) - 1, 1, arch);
-    //checksum
-    fread(&file_header->checksum, sizeof(uint32_t), 1, arch);
-    //number of files
-    fread(&file_header->file_num, sizeof(int), 1, arch);
-    //file info
-    file_header->file_name = (char**)calloc(file_header->file_num, sizeof(char*));
-    file_header->file_size = (unsigned*)calloc(file_header->file_num, sizeof(int));
-    file_header->comp_size = (unsigned*)calloc(file_header->file_num, sizeof(int));
-    file_header->add_time = (time_t*)calloc(file_header->file_num, sizeof(time_t));
-    unsigned char name_size = 0;
-    for (unsigned i = 0; i < file_header->file_num; ++i) {
-        //file name size
-        fread(&name_size, sizeof(char), 1, arch);
-        file_header->file_name[i] = (char*)calloc(name_size, sizeof(char));
-        //read file name
-        fread(file_header->file_name[i], sizeof(char), name_size, arch);
-        //read file size
-        fread(&file_header->file_size[i], sizeof(int), 1, arch);
-        //read compressed file size
-        fread(&file_header->comp_size[i], sizeof(int), 1, arch);
-        //read add time
-        fread(&file_header->add_time[i], sizeof(time_t), 1, arch);
-    }
-    return file_header;
-}
-
-void skip_file_info(FILE *arch) {
-    unsigned char name_size = 0;
-    fread(&name_size, sizeof(char), 1, arch);
-    file_shift_pos(arch, name_size + 2 * sizeof(int) + sizeof(time_t));
-}
-
-void skip_header(FILE *arch) {
-    unsigned file_num = read_num_of_files(arch);
-    file_set_pos(arch, FILE_INFO_FILEPOS);;
-    for (unsigned i = 0; i < file_num; ++i) {
-        skip_file_info(arch);
-    }
-}
-
-void destroy_header(Header *file_header) {
-    if (file_header) {
-        for (unsigned i = 0; i < file_header->file_num; ++i) {
-            free(file_header->file_name[i]);
-        }
-        free(file_header->file_name);
-        free(file_header->file_size);
-        free(file_header->comp_size);
-        free(file_header->add_time);
-        free(file_header);
-    }
-}
-
-//append to archive
-
-unsigned compress_files(FILE *arch, FILE *temp_file, char **file_names, unsigned file_num) {
-    //returns the number of successfully compressed files
-    FILE *file_in = NULL;
-    unsigned file_cnt = 0;
-    unsigned file_beg_pos = ftell(temp_file);
-    //compress the requested files
-    for (unsigned i = 0; i < file_num; ++i) {
-        //open an input file
-        if ((file_in = fopen(file_names[i], "rb"))) {
-            //compress the input file
-            encode_file(file_in, temp_file);
-            //write input file info to the archive
-            write_file_info(arch, file_names[i], ftell(file_in),
-                            ftell(temp_file) - file_beg_pos, time(NULL));
-            //close the input file
-            file_close(file_in);
-            //change the number of compressed files & the beginning position in temp_file
-            file_beg_pos = ftell(temp_file);
-            ++file_cnt;
-            print_msg("\t<<%s>>: added!\n", file_names[i]);
-        }
-        else {
-            print_error("\t<<%s>>: failed to open!\n", file_names[i]);
-        }
-    }
-    return file_cnt;
-}
-
-unsigned append_to_archive(FILE *arch, char **file_names, unsigned file_num) {
-    //skip archive's header
-    skip_header(arch);
-    //open temporary file
-    FILE *temp_file = tmpfile();
-    if (temp_file == NULL) {
-        print_error("\nFailed to add the files to the archive!\n");
-        return 0;
-    }
-    //copy the archive to the temporary file & skip archive's header again
-    concat_files(temp_file, arch);
-    skip_header(arch);
-    //compress the requested files & add new info to the archive's header
-    unsigned file_cnt = compress_files(arch, temp_file, file_names, file_num);
-    //rewind the temporary file and concatenate with the archive
-    rewind(temp_file);
-    concat_files(arch, temp_file);
-    //close the temporary file
-    file_close(temp_file);
-    //rewrite the number of files
-    write_num_of_files(arch, file_cnt + read_num_of_files(arch));
-    //refresh the checksum
-    refresh_checksum(arch);
-    return file_cnt;
-}
-
-//create archive
-
-int create_archive(const char *arch_name) {
-    //open a file
-    FILE *arch = fopen(arch_name, "wb+");
-    if (arch == NULL) {
-        return 1;
-    }
-    //write file signature & zero checksum & zero number of files as a placeholder
-    write_magic_number(arch);
-    write_checksum(arch, 0);
-    write_num_of_files(arch, 0);
-    //refresh the checksum
-    refresh_checksum(arch);
-    //close the file
-    file_close(arch);
-    return 0;
-}
-
-//extract
-
-#define FILENAME_LEN 256
-
-char strbuf[FILENAME_LEN] = {0};
-
-char *make_file_name(const char *format, ...) {
-    va_list argptr;
-    va_start(argptr, format);
-    vsnprintf(strbuf, FILENAME_LEN, format, argptr);
-    va_end(argptr);
-    return strbuf;
-}
-
-unsigned extract_files(FILE *arch, Header *header, char *files_to_extract) {
-    FILE *file = NULL;
-    unsigned file_cnt = 0;
-    unsigned beg_pos = ftell(arch), shift = 0;
-    for (unsigned i = 0; i < header->file_num; ++i) {
-        file_set_pos(arch, beg_pos + shift);
-        if (files_to_extract[i]) {
-            file = fopen(header->file_name[i], "wb");
-            if (file == NULL) {
-                print_error("\t<<%s>>: failed!\n", header->file_name[i]);
-            }
-            else {
-                decode_file(arch, file, header->file_size[i]);
-                file_close(file);
-                ++file_cnt;
-                print_msg("\t<<%s>>: extracted!\n", header->file_name[i]);
-            }
-        }
-        shift += header->comp_size[i];
-    }
-    return file_cnt;
-}
-
-
-unsigned extract_from_archive(FILE *arch, char **file_names, unsigned file_num) {
-    //read archive header
-    Header *header = read_header(arch);
-    //files to extract
-    char files_to_extract[header->file_num];
-    memset(files_to_extract, 0, header->file_num);
-    //find files to extract
-    for (unsigned i = 0, j = 0; i < file_num; ++i) {
-        for (j = 0; j < header->file_num; ++j) {
-            if (!strcmp(header->file_name[j], file_names[i])) {
-                //file was found in the archive
-                files_to_extract[j] = 1;
-                break;
-            }
-        }
-        if (j == header->file_num) {
-            //file was not found
-            print_error("\t<<%s>> was not found in the archive!\n", file_names[i]);
-        }
-    }
-    //extract files
-    unsigned file_cnt = extract_files(arch, header, files_to_extract);
-    //free resources
-    destroy_header(header);
-    return file_cnt;
-}
-
-unsigned extract_all(FILE *arch) {
-    //read archive header
-    Header *header = read_header(arch);
-    //files to extract
-    char files_to_extract[header->file_num]; //kostyl
-    memset(files_to_extract, 1, header->file_num);
-    //extract files
-    unsigned file_cnt = extract_files(arch, header, files_to_extract);
-    //free resources
-    destroy_header(header);
-    return file_cnt;
-}
-
-//remove from archive
-
-unsigned delete_files(FILE *arch, FILE *temp_file, Header *header, char *files_to_delete) {
-    //write header
-    for (unsigned i = 0; i < header->file_num; ++i) {
-        if (!files_to_delete[i]) {
-            write_file_info(temp_file, header->file_name[i], header->file_size[i],
-                            header->comp_size[i], header->add_time[i]);
-        }
-    }
-    //write the files except from deleted
-    unsigned file_cnt = 0;
-    unsigned beg_pos = ftell(arch), shift = 0;
-    for (unsigned i = 0; i < header->file_num; ++i) {
-        file_set_pos(arch, beg_pos + shift);
-        if (files_to_delete[i]) {
-            print_msg("\t<<%s>>: deleted!\n", header->file_name[i]);
-            ++file_cnt;
-        }
-        else {
-            file_copy_block(arch, temp_file, header->comp_size[i]);
-        }
-        shift += header->comp_size[i];
-    }
-    return file_cnt;
-}
-
-unsigned remove_from_archive(FILE *arch, char *arch_name, char **file_names, unsigned file_num) {
-    //read archive header
-    Header *header = read_header(arch);
-    //files to delete
-    char files_to_delete[header->file_num];
-    memset(files_to_delete, 0, header->file_num);
-    //find files to delete
-    for (unsigned i = 0, j = 0; i < file_num; ++i) {
-        for (j = 0; j < header->file_num; ++j) {
-            if (!strcmp(header->file_name[j], file_names[i])) {
-                //file was found in the archive
-                files_to_delete[j] = 1;
-                break;
-            }
-        }
-        if (j == header->file_num) {
-            //file was not found
-            print_error("\t<<%s>> was not found in the archive!\n", file_names[i]);
-        }
-    }
-    //open temporary fi;e
-    FILE *temp_file = tmpfile();
-    if (temp_file == NULL) {
-        print_error("\tFailed to delete files from the archive!\n");
-        return 0;
-    }
-    //a placeholder for the magic number, checksum and number of files
-    write_magic_number(temp_file);
-    write_checksum(temp_file, 0);
-    write_num_of_files(temp_file, 0);
-    //delete files
-    unsigned file_cnt = delete_files(arch, temp_file, header, files_to_delete);
-    //rewrite the number of files and checksum
-    write_num_of_files(temp_file, header->file_num - file_cnt);
-    refresh_checksum(temp_file);
-    rewind(temp_file);
-
-    //close the archive & open to write the temporary file there
-    file_close(arch);
-    arch = fopen(arch_name, "wb");
-    if (arch == NULL) {
-        print_error("\tOoops...");
-    }
-    else {
-        concat_files(arch, temp_file);
-    }
-    file_close(temp_file);
-
-    //free resources
-    destroy_header(header);
-    return file_cnt;
-}
-
-//print archive information
-
-void print_arch_info(FILE *arch, char *arch_name) {
-    Header *file_header = read_header(arch);
-    //print name
-    print_msg("\n\t>>Archive name: <<%s>>\n", arch_name);
-    //print checksum
-    print_msg("\n\t>>Checksum: 0x%08X\n", file_header->checksum);
-    //print number of files
-    print_msg("\n\t>>Number of files: %u\n", file_header->file_num);
-    //print file info
-    if (file_header->file_num > 0) {
-        print_msg("\n\t\t***File list***\n\n");
-    }
-    for (unsigned i = 0; i < file_header->file_num; ++i) {
-        //file name
-        print_msg("\t<<%s>>\n", file_header->file_name[i]);
-        //file size
-        print_msg("\t*File size: %u bytes\n", file_header->file_size[i]);
-        //compressed file size
-        print_msg("\t*Compressed file size: %u bytes\n", file_header->comp_size[i]);
-        //compression ratio
-        print_msg("\t*Compression: %d%%\n", (file_header->comp_size[i] >= file_header->file_size[i]) ?
-                    0 : (int)((1.0 - (double)file_header->comp_size[i] / file_header->file_size[i]) * 100.0));
-        //add time
-        print_msg("\t*Add time: %s\n", ctime(&file_header->add_time[i]));
-    }
-    destroy_header(file_header);
-}
-
-//check archive's integrity
-
-int check_archive_checksum(FILE *arch) {
-    //read checksum
-    uint32_t checksum = read_checksum(arch);
-    //get checksum & compare
-    file_set_pos(arch, FILE_NUM_FILEPOS);
-    return checksum == get_checksum(arch);
-}
-
-//archiver menu
-
-void choice_menu(char *arch_name, char **file_names, unsigned file_num, MenuOption opt) {
-    if (access(arch_name, R_OK) != 0) {
-        //an archive does not exist
-        print_msg("\tThe file <<%s>> does not exist. Creating...\n", arch_name);
-        if (create_archive(arch_name)) {
-            print_error("\tFailed to create an archive!\n");
-            return;
-        }
-    }
-    print_msg("\tOpening <<%s>>...\n", arch_name);
-    FILE *arch = fopen(arch_name, "rb+");
-    if (arch == NULL) {
-        print_error("\tFailed to open <<%s>>!\n", arch_name);
-        return;
-    }
-    if (!check_magic_num(arch)) {
-        print_error("\tThe file <<%s>> is not an archive!\n", arch_name);
-        goto close_files;
-    }
-    if (!check_archive_checksum(arch)) {
-        print_error("\tThe archive <<%s>> is corrupted!\n", arch_name);
-        goto close_files;
-    }
-    rewind(arch);
-    switch (opt) {
-        case AddToArchive:
-            print_msg("\tFiles added: %u\n",
-                      append_to_archive(arch, file_names, file_num));
-            break;
-        case ExtractFromArchive:
-            print_msg("\tFiles extracted: %u\n",
-                       extract_from_archive(arch, file_names, file_num));
-            break;
-        case ExtractAll:
-            print_msg("\tFiles extracted: %u\n",
-                       extract_all(arch));
-            break;
-        case RemoveFromArchive:
-            print_msg("\tFiles removed: %u\n",
-                      remove_from_archive(arch, arch_name, file_names, file_num));
-            break;
-        case CheckIntegrity:
-            print_msg("\tThe archive <<%s>> is OK!\n", arch_name);
-            break;
-        case PrintInfo:
-            print_arch_info(arch, arch_name);
-            break;
-        default:
-            print_error("Invalid option!\n");
-            break;
-    }
-    close_files:
-    file_close(arch);
-}
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include "archiver.h"
+#include "file_processing.h"
+#include "huffman_tree.h"
+#include "huffman_coding.h"
+#include "hash_map.h"
+#include "thread_pool.h"
+#include "stats.h"
+#include "trace.h"
+#include "dir_walk.h"
+#include "uring_writer.h"
+
+//print message & error
+
+//messages go to stderr while members are decoded to stdout
+
+static FILE *msg_out = NULL;
+
+void print_msg(const char *msg, ...) {
+    va_list argptr;
+    va_start(argptr, msg);
+    vfprintf((msg_out != NULL) ? msg_out : stdout, msg, argptr);
+    va_end(argptr);
+}
+
+void print_error(const char *msg, ...) {
+    va_list argptr;
+    va_start(argptr, msg);
+    vfprintf(stderr, msg, argptr);
+    va_end(argptr);
+}
+
+//options of the current operation
+
+ArchiverOptions arch_options = {0};
+
+//file signature
+
+const char magic_num[] = "MAGIC_NUMBER";
+
+//version of the archive format, increased when the layout changes (older archives aren't read)
+
+#define FORMAT_VERSION 2
+
+//archive positions
+
+#define MAGIC_NUM_FILEPOS   0
+#define VERSION_FILEPOS     (MAGIC_NUM_FILEPOS + sizeof(magic_num) - 1)
+#define CHECKSUM_FILEPOS    (VERSION_FILEPOS + sizeof(uint32_t))
+#define FILE_NUM_FILEPOS    (CHECKSUM_FILEPOS + sizeof(uint32_t))
+#define DIR_SIZE_FILEPOS    (FILE_NUM_FILEPOS + sizeof(int))
+#define DIRECTORY_FILEPOS   (DIR_SIZE_FILEPOS + sizeof(int))
+
+//read file signature, format version & checksum
+
+int check_magic_num(FILE *arch) {
+    file_set_pos(arch, MAGIC_NUM_FILEPOS);
+    static char buf[sizeof(magic_num)] = {0};
+    fread(buf, sizeof(magic_num) - 1, 1, arch);
+    rewind(arch);
+    return !strcmp(magic_num, buf);
+}
+
+uint32_t read_format_version(FILE *arch) {
+    file_set_pos(arch, VERSION_FILEPOS);
+    uint32_t version = 0;
+    fread(&version, sizeof(uint32_t), 1, arch);
+    rewind(arch);
+    return version;
+}
+
+uint32_t read_checksum(FILE *arch) {
+    file_set_pos(arch, CHECKSUM_FILEPOS);
+    uint32_t checksum = 0;
+    fread(&checksum, sizeof(uint32_t), 1, arch);
+    return checksum;
+}
+
+//write info to the header
+
+void write_checksum(FILE *arch, uint32_t checksum) {
+    file_set_pos(arch, CHECKSUM_FILEPOS);
+    fwrite(&checksum, sizeof(uint32_t), 1, arch);
+}
+
+//file info
+
+typedef struct FileInfo {
+    char *name;
+    unsigned size;
+    unsigned comp_size;
+    time_t add_time;
+    //modification time of the source file
+    time_t mod_time;
+    //position of the compressed data relative to the end of the header
+    unsigned data_pos;
+    //content hash of the source file
+    uint64_t hash;
+    //CodingMethod of the compressed data
+    unsigned char method;
+    //checksum of the source file
+    uint32_t crc;
+    //compression level the file was added with
+    unsigned char level;
+} FileInfo;
+
+//archive header
+
+typedef struct Header {
+    char file_signature[sizeof(magic_num)];
+    uint32_t checksum;
+    unsigned file_num;
+    unsigned capacity;
+    FileInfo *file;
+} Header;
+
+void header_reserve(Header *file_header, unsigned capacity) {
+    if (capacity > file_header->capacity) {
+        file_header->file = (FileInfo*)realloc(file_header->file, capacity * sizeof(FileInfo));
+        file_header->capacity = capacity;
+    }
+}
+
+unsigned header_add_file(Header *file_header, const FileInfo *info) {
+    //returns the index of the new entry
+    unsigned i = file_header->file_num;
+    if (i == file_header->capacity) {
+        header_reserve(file_header, (i > 0) ? 2 * i : 8);
+    }
+    file_header->file[i] = *info;
+    file_header->file[i].name = strdup(info->name);
+    ++file_header->file_num;
+    return i;
+}
+
+void destroy_header(Header *file_header) {
+    if (file_header) {
+        for (unsigned i = 0; i < file_header->file_num; ++i) {
+            free(file_header->file[i].name);
+        }
+        free(file_header->file);
+        free(file_header);
+    }
+}
+
+//directory: the entries sorted by name (the entries of the same name in the order they were added)
+//in blocks of about DIR_BLOCK_SIZE bytes, each coded statically on its own;
+//an entry's name shares a prefix with the name before it in the block & the numbers are varints:
+//  prefix length, suffix length, suffix, size, compressed size, data position,
+//  modification & add time (differences from the entry before), hash, coding method, checksum, level
+//the blocks are preceded by their index (the first name of every block), so a name is looked up
+//by a binary search of the index & the decoding of one block:
+//  number of blocks, {offset, compressed size, size, number of entries, checksum, coding method,
+//  first name length, first name} per block, the blocks
+
+#define DIR_BLOCK_SIZE (32u << 10)
+
+typedef struct DirBlock {
+    //position of the coded block after the index
+    unsigned offset;
+    unsigned comp_size;
+    unsigned size;
+    unsigned entry_num;
+    uint32_t crc;
+    unsigned char method;
+    //the first name of the block (not terminated)
+    const char *first_name;
+    unsigned first_len;
+} DirBlock;
+
+typedef struct Directory {
+    //the coded blocks
+    const unsigned char *data;
+    unsigned size;
+    unsigned block_num;
+    DirBlock *block;
+} Directory;
+
+//growing buffer of an encoded block
+
+typedef struct ByteBuf {
+    unsigned char *data;
+    unsigned size;
+    unsigned capacity;
+} ByteBuf;
+
+#define BYTE_BUF_MIN_CAPACITY 256
+
+void buf_put(ByteBuf *buf, const void *data, unsigned size) {
+    if (buf->size + size > buf->capacity) {
+        //the entries are put field by field, so the first allocation takes a few of them
+        buf->capacity = (buf->size + size > 2 * buf->capacity) ? buf->size + size : 2 * buf->capacity;
+        buf->capacity = (buf->capacity < BYTE_BUF_MIN_CAPACITY) ? BYTE_BUF_MIN_CAPACITY : buf->capacity;
+        buf->data = (unsigned char*)realloc(buf->data, buf->capacity);
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+void buf_put_varint(ByteBuf *buf, uint64_t value) {
+    //7 bits per byte, the lowest first; the high bit marks the bytes that are followed by more
+    unsigned char bytes[10];
+    unsigned len = 0;
+    do {
+        bytes[len++] = (value & 0x7F) | ((value > 0x7F) ? 0x80 : 0);
+        value >>= 7;
+    } while (value > 0);
+    buf_put(buf, bytes, len);
+}
+
+uint64_t zigzag(int64_t value) {
+    //small differences of either sign are small varints
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+//reading from memory (a mapped archive or a decoded block)
+
+typedef struct MapCursor {
+    const unsigned char *pos;
+    const unsigned char *end;
+} MapCursor;
+
+int map_read(MapCursor *cursor, void *to, unsigned size) {
+    //returns 0 at the end of the data
+    if ((unsigned)(cursor->end - cursor->pos) < size) {
+        return 0;
+    }
+    memcpy(to, cursor->pos, size);
+    cursor->pos += size;
+    return 1;
+}
+
+int map_read_varint(MapCursor *cursor, uint64_t *value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64 && cursor->pos < cursor->end; shift += 7) {
+        unsigned char byte = *cursor->pos++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int map_read_uint(MapCursor *cursor, unsigned *value) {
+    //a varint that fits into unsigned
+    uint64_t value64 = 0;
+    *value = 0;
+    if (!map_read_varint(cursor, &value64) || value64 > UINT_MAX) {
+        return 0;
+    }
+    *value = value64;
+    return 1;
+}
+
+//entries
+
+void put_file_info(ByteBuf *buf, const FileInfo *info, const FileInfo *prev) {
+    //prev is the entry before in the block (NULL for the first one)
+    unsigned prefix = 0, name_len = strlen(info->name);
+    while (prev != NULL && prev->name[prefix] != '\0' && prev->name[prefix] == info->name[prefix]) {
+        ++prefix;
+    }
+    buf_put_varint(buf, prefix);
+    buf_put_varint(buf, name_len - prefix);
+    buf_put(buf, info->name + prefix, name_len - prefix);
+    buf_put_varint(buf, info->size);
+    buf_put_varint(buf, info->comp_size);
+    buf_put_varint(buf, info->data_pos);
+    buf_put_varint(buf, zigzag((int64_t)info->mod_time - ((prev != NULL) ? (int64_t)prev->mod_time : 0)));
+    buf_put_varint(buf, zigzag((int64_t)info->add_time - ((prev != NULL) ? (int64_t)prev->add_time : 0)));
+    buf_put(buf, &info->hash, sizeof(uint64_t));
+    buf_put(buf, &info->method, sizeof(char));
+    buf_put(buf, &info->crc, sizeof(uint32_t));
+    buf_put(buf, &info->level, sizeof(char));
+}
+
+int map_file_info(MapCursor *cursor, FileInfo *info, const FileInfo *prev) {
+    //returns 0 if the entry is corrupted (the name is allocated anyway)
+    unsigned prefix = 0, suffix = 0;
+    uint64_t mod_time = 0, add_time = 0;
+    info->name = NULL;
+    if (!map_read_uint(cursor, &prefix) || !map_read_uint(cursor, &suffix) ||
+        prefix > ((prev != NULL) ? strlen(prev->name) : 0) || suffix > (unsigned)(cursor->end - cursor->pos)) {
+        return 0;
+    }
+    info->name = (char*)calloc(prefix + suffix + 1, sizeof(char));
+    if (prefix > 0) {
+        memcpy(info->name, prev->name, prefix);
+    }
+    if (!map_read(cursor, info->name + prefix, suffix) ||
+        !map_read_uint(cursor, &info->size) ||
+        !map_read_uint(cursor, &info->comp_size) ||
+        !map_read_uint(cursor, &info->data_pos) ||
+        !map_read_varint(cursor, &mod_time) ||
+        !map_read_varint(cursor, &add_time) ||
+        !map_read(cursor, &info->hash, sizeof(uint64_t)) ||
+        !map_read(cursor, &info->method, sizeof(char)) ||
+        !map_read(cursor, &info->crc, sizeof(uint32_t)) ||
+        !map_read(cursor, &info->level, sizeof(char))) {
+        return 0;
+    }
+    info->mod_time = unzigzag(mod_time) + ((prev != NULL) ? (int64_t)prev->mod_time : 0);
+    info->add_time = unzigzag(add_time) + ((prev != NULL) ? (int64_t)prev->add_time : 0);
+    return 1;
+}
+
+//writing the header
+
+static Header *sort_header = NULL;
+
+static int cmp_names(const void *a, const void *b) {
+    //the entries of the same name stay in their order
+    unsigned ix_a = *(const unsigned*)a, ix_b = *(const unsigned*)b;
+    int cmp = strcmp(sort_header->file[ix_a].name, sort_header->file[ix_b].name);
+    return (cmp != 0) ? cmp : (ix_a > ix_b) - (ix_a < ix_b);
+}
+
+void put_block_index(ByteBuf *index, const DirBlock *block, unsigned block_num) {
+    //the index has the same size whatever the blocks are coded to
+    for (unsigned i = 0; i < block_num; ++i) {
+        buf_put(index, &block[i].offset, sizeof(int));
+        buf_put(index, &block[i].comp_size, sizeof(int));
+        buf_put(index, &block[i].size, sizeof(int));
+        buf_put(index, &block[i].entry_num, sizeof(int));
+        buf_put(index, &block[i].crc, sizeof(uint32_t));
+        buf_put(index, &block[i].method, sizeof(char));
+        buf_put_varint(index, block[i].first_len);
+        buf_put(index, block[i].first_name, block[i].first_len);
+    }
+}
+
+unsigned put_directory(Header *header, ByteBuf *raw, DirBlock **block) {
+    //puts the entries sorted by name to blocks in memory (they aren't coded); returns the number of blocks
+    unsigned *order = (unsigned*)malloc((header->file_num + 1) * sizeof(int));
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        order[i] = i;
+    }
+    sort_header = header;
+    qsort(order, header->file_num, sizeof(int), cmp_names);
+    unsigned block_num = 0, block_cap = 0, block_beg = raw->size;
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        const FileInfo *info = &header->file[order[i]];
+        if (raw->size == block_beg) {
+            if (block_num == block_cap) {
+                block_cap = (block_cap > 0) ? 2 * block_cap : 8;
+                *block = (DirBlock*)realloc(*block, block_cap * sizeof(DirBlock));
+            }
+            memset(&(*block)[block_num], 0, sizeof(DirBlock));
+            (*block)[block_num].first_name = info->name;
+            (*block)[block_num].first_len = strlen(info->name);
+        }
+        put_file_info(raw, info, (raw->size > block_beg) ? &header->file[order[i - 1]] : NULL);
+        ++(*block)[block_num].entry_num;
+        if (raw->size - block_beg >= DIR_BLOCK_SIZE || i + 1 == header->file_num) {
+            (*block)[block_num++].size = raw->size - block_beg;
+            block_beg = raw->size;
+        }
+    }
+    free(order);
+    return block_num;
+}
+
+unsigned write_header(FILE *arch, Header *header) {
+    //writes the signature, the format version, a zero checksum (see refresh_checksum()), the number of files
+    //& the directory; returns the position of the files' data
+    double beg = stats_now();
+    trace_begin("directory", NULL);
+    //the coding of the directory is a part of any operation, so it isn't cancelled & it's measured as a whole
+    progress_suspend();
+    stats_suspend();
+    ByteBuf raw = {0}, index = {0};
+    DirBlock *block = NULL;
+    unsigned block_num = put_directory(header, &raw, &block);
+    //signature, version, checksum, number of files & directory: the blocks are coded right after the index,
+    //which is written again with their offsets
+    put_block_index(&index, block, block_num);
+    unsigned dir_size = 0, index_end = DIRECTORY_FILEPOS + sizeof(int) + index.size, block_beg = 0;
+    uint32_t version = FORMAT_VERSION, checksum = 0;
+    rewind(arch);
+    fwrite(magic_num, sizeof(magic_num) - 1, 1, arch);
+    fwrite(&version, sizeof(uint32_t), 1, arch);
+    fwrite(&checksum, sizeof(uint32_t), 1, arch);
+    fwrite(&header->file_num, sizeof(int), 1, arch);
+    fwrite(&dir_size, sizeof(int), 1, arch);
+    fwrite(&block_num, sizeof(int), 1, arch);
+    if (index.size > 0) {
+        fwrite(index.data, sizeof(char), index.size, arch);
+    }
+    for (unsigned i = 0; i < block_num; ++i) {
+        block[i].offset = ftell(arch) - index_end;
+        encode_memory(raw.data + block_beg, block[i].size, arch);
+        block[i].comp_size = ftell(arch) - index_end - block[i].offset;
+        block[i].crc = get_file_crc();
+        block[i].method = (get_zero_run_num() > 0) ? SparseCoding : StaticCoding;
+        block_beg += block[i].size;
+    }
+    unsigned header_end = ftell(arch);
+    dir_size = header_end - DIRECTORY_FILEPOS;
+    index.size = 0;
+    put_block_index(&index, block, block_num);
+    file_set_pos(arch, DIR_SIZE_FILEPOS);
+    fwrite(&dir_size, sizeof(int), 1, arch);
+    fwrite(&block_num, sizeof(int), 1, arch);
+    if (index.size > 0) {
+        fwrite(index.data, sizeof(char), index.size, arch);
+    }
+    file_set_pos(arch, header_end);
+    free(raw.data);
+    free(index.data);
+    free(block);
+    stats_resume();
+    progress_resume();
+    trace_end("directory");
+    stats_add_phase(PhaseDirectory, beg, raw.size, dir_size);
+    return header_end;
+}
+
+unsigned get_header_size(Header *header) {
+    //the size write_header() would write: the blocks are only analyzed, their coded size is known from
+    //the code lengths
+    progress_suspend();
+    stats_suspend();
+    ByteBuf raw = {0}, index = {0};
+    DirBlock *block = NULL;
+    unsigned block_num = put_directory(header, &raw, &block);
+    put_block_index(&index, block, block_num);
+    unsigned size = DIRECTORY_FILEPOS + sizeof(int) + index.size, block_beg = 0;
+    for (unsigned i = 0; i < block_num; ++i) {
+        analyze_memory(raw.data + block_beg, block[i].size);
+        size += get_coded_size();
+        block_beg += block[i].size;
+    }
+    free(raw.data);
+    free(index.data);
+    free(block);
+    stats_resume();
+    progress_resume();
+    return size;
+}
+
+//reading the header
+
+int map_directory(const unsigned char *data, unsigned size, unsigned file_num, Directory *dir) {
+    //the index is parsed, the blocks are decoded when they're needed; returns 0 if the index is corrupted
+    MapCursor cursor = {data, data + size};
+    unsigned entry_num = 0;
+    dir->block = NULL;
+    if (!map_read(&cursor, &dir->block_num, sizeof(int)) || dir->block_num > size) {
+        dir->block_num = 0;
+        return 0;
+    }
+    dir->block = (DirBlock*)calloc(dir->block_num + 1, sizeof(DirBlock));
+    for (unsigned i = 0; i < dir->block_num; ++i) {
+        DirBlock *block = &dir->block[i];
+        if (!map_read(&cursor, &block->offset, sizeof(int)) ||
+            !map_read(&cursor, &block->comp_size, sizeof(int)) ||
+            !map_read(&cursor, &block->size, sizeof(int)) ||
+            !map_read(&cursor, &block->entry_num, sizeof(int)) ||
+            !map_read(&cursor, &block->crc, sizeof(uint32_t)) ||
+            !map_read(&cursor, &block->method, sizeof(char)) ||
+            !map_read_uint(&cursor, &block->first_len) ||
+            block->first_len > (unsigned)(cursor.end - cursor.pos) || block->entry_num == 0) {
+            return 0;
+        }
+        block->first_name = (const char*)cursor.pos;
+        cursor.pos += block->first_len;
+        entry_num += block->entry_num;
+    }
+    dir->data = cursor.pos;
+    dir->size = cursor.end - cursor.pos;
+    for (unsigned i = 0; i < dir->block_num; ++i) {
+        if ((unsigned long long)dir->block[i].offset + dir->block[i].comp_size > dir->size) {
+            return 0;
+        }
+    }
+    return entry_num == file_num;
+}
+
+int decode_block(const Directory *dir, unsigned block_ix, Header *header) {
+    //adds the entries of the block to the header; returns 0 if the block is corrupted
+    const DirBlock *block = &dir->block[block_ix];
+    unsigned char *raw = (unsigned char*)malloc(block->size + 1);
+    FILE *raw_file = fmemopen(raw, block->size + 1, "w");
+    if (raw_file == NULL) {
+        free(raw);
+        return 0;
+    }
+    //the block is measured by the caller
+    progress_suspend();
+    stats_suspend();
+    uint32_t crc = decode_memory(dir->data + block->offset, raw_file, block->size, block->comp_size, block->method);
+    stats_resume();
+    progress_resume();
+    fclose(raw_file);
+    int ok = (crc == block->crc);
+    MapCursor cursor = {raw, raw + block->size};
+    header_reserve(header, header->file_num + block->entry_num);
+    for (unsigned i = 0; i < block->entry_num && ok; ++i) {
+        FileInfo *info = &header->file[header->file_num];
+        ok = map_file_info(&cursor, info, (i > 0) ? info - 1 : NULL);
+        if (info->name != NULL) {
+            ++header->file_num;
+        }
+    }
+    free(raw);
+    return ok;
+}
+
+Header *load_header(const Directory *dir, const unsigned char *prefix) {
+    //decodes all the blocks; returns NULL if the directory is corrupted
+    Header *file_header = (Header*)calloc(1, sizeof(Header));
+    memcpy(file_header->file_signature, prefix + MAGIC_NUM_FILEPOS, sizeof(magic_num) - 1);
+    memcpy(&file_header->checksum, prefix + CHECKSUM_FILEPOS, sizeof(uint32_t));
+    double beg = stats_now();
+    trace_begin("directory", NULL);
+    int ok = 1;
+    for (unsigned i = 0; i < dir->block_num && ok; ++i) {
+        ok = decode_block(dir, i, file_header);
+    }
+    trace_end("directory");
+    stats_add_phase(PhaseDirectory, beg, dir->size, 0);
+    if (!ok) {
+        destroy_header(file_header);
+        return NULL;
+    }
+    return file_header;
+}
+
+int find_block(const Directory *dir, const char *file_name, unsigned *block_ix) {
+    //the last block whose first name isn't after the name: the last entry of the name is there
+    unsigned lo = 0, hi = dir->block_num, name_len = strlen(file_name);
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        const DirBlock *block = &dir->block[mid];
+        int cmp = memcmp(block->first_name, file_name, (block->first_len < name_len) ? block->first_len : name_len);
+        if (cmp < 0 || (cmp == 0 && block->first_len <= name_len)) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    *block_ix = lo - 1;
+    return lo > 0;
+}
+
+Header *read_header(FILE *arch) {
+    //the archive is left positioned at the files' data; returns an empty header if the directory is corrupted
+    //or of another format version (the header checksum is checked before)
+    unsigned char prefix[DIRECTORY_FILEPOS];
+    unsigned file_num = 0, dir_size = 0;
+    uint32_t version = 0;
+    file_set_pos(arch, MAGIC_NUM_FILEPOS);
+    memset(prefix, 0, sizeof(prefix));
+    fread(prefix, sizeof(prefix), 1, arch);
+    memcpy(&version, prefix + VERSION_FILEPOS, sizeof(uint32_t));
+    if (version != FORMAT_VERSION) {
+        print_error("\tThe archive has an unsupported format version (%u)!\n", version);
+        return (Header*)calloc(1, sizeof(Header));
+    }
+    memcpy(&file_num, prefix + FILE_NUM_FILEPOS, sizeof(int));
+    memcpy(&dir_size, prefix + DIR_SIZE_FILEPOS, sizeof(int));
+    unsigned char *data = (unsigned char*)malloc(dir_size + 1);
+    dir_size = fread(data, sizeof(char), dir_size, arch);
+    Directory dir;
+    Header *file_header = map_directory(data, dir_size, file_num, &dir) ? load_header(&dir, prefix) : NULL;
+    if (file_header == NULL) {
+        print_error("\tThe directory of the archive is corrupted!\n");
+        file_header = (Header*)calloc(1, sizeof(Header));
+    }
+    free(dir.block);
+    free(data);
+    return file_header;
+}
+
+void skip_header(FILE *arch) {
+    unsigned dir_size = 0;
+    file_set_pos(arch, DIR_SIZE_FILEPOS);
+    fread(&dir_size, sizeof(int), 1, arch);
+    file_set_pos(arch, DIRECTORY_FILEPOS + dir_size);
+}
+
+//header checksum: covers the number of files & the directory, but not the files' data
+//(the data of every file is checked against the file's checksum when it is decoded)
+
+uint32_t get_header_checksum(FILE *arch) {
+    double beg = stats_now();
+    trace_begin("checksum", NULL);
+    skip_header(arch);
+    unsigned header_end = ftell(arch);
+    //count the checksum from the position right after the checksum
+    file_set_pos(arch, FILE_NUM_FILEPOS);
+    uint32_t checksum = get_block_checksum(arch, header_end - FILE_NUM_FILEPOS);
+    trace_end("checksum");
+    stats_add_phase(PhaseChecksum, beg, header_end - FILE_NUM_FILEPOS, 0);
+    return checksum;
+}
+
+void refresh_checksum(FILE *arch) {
+    //count & write the checksum to the header
+    write_checksum(arch, get_header_checksum(arch));
+}
+
+//archive in memory: the header is decoded from the mapped archive & the members are decoded in place
+
+typedef struct ArchiveView {
+    FileMap map;
+    Header *header;
+    //position of the files' data
+    unsigned data_beg;
+    //the index of the directory, whose blocks are decoded to the header by load_view()
+    Directory dir;
+    //data added by a batch, not written to the archive yet: the data positions from new_beg on
+    FileMap new_map;
+    unsigned new_beg;
+} ArchiveView;
+
+const unsigned char *member_data(const ArchiveView *view, const FileInfo *info) {
+    //returns NULL if the member's data is out of the archive
+    if (info->data_pos >= view->new_beg) {
+        unsigned long long data_end = (unsigned long long)info->data_pos - view->new_beg + info->comp_size;
+        return (data_end <= view->new_map.size && view->new_map.data != NULL) ?
+               view->new_map.data + info->data_pos - view->new_beg : NULL;
+    }
+    unsigned long long data_end = (unsigned long long)view->data_beg + info->data_pos + info->comp_size;
+    return (data_end <= view->map.size) ? view->map.data + view->data_beg + info->data_pos : NULL;
+}
+
+void prefetch_member(const ArchiveView *view, const FileInfo *info) {
+    if (member_data(view, info) == NULL) {
+        return;
+    }
+    if (info->data_pos >= view->new_beg) {
+        file_map_prefetch(&view->new_map, info->data_pos - view->new_beg, info->comp_size);
+    }
+    else {
+        file_map_prefetch(&view->map, view->data_beg + info->data_pos, info->comp_size);
+    }
+}
+
+uint32_t decode_member(const ArchiveView *view, FILE *file, const FileInfo *info) {
+    //returns the checksum of the decoded data (a member out of the archive is decoded from nothing)
+    const unsigned char *data = member_data(view, info);
+    return decode_memory(data, file, info->size, (data != NULL) ? info->comp_size : 0, info->method);
+}
+
+//member names
+
+const char *get_member_name(const char *path) {
+    //a file is stored by a relative name, which is_safe_path() lets out on extraction:
+    //the leading slashes & everything up to the last ".." are dropped (as tar does)
+    const char *name = path;
+    for (const char *part = path; *part != '\0'; ) {
+        const char *end = strchr(part, '/');
+        end = (end != NULL) ? end : part + strlen(part);
+        if (end - part == 2 && part[0] == '.' && part[1] == '.') {
+            name = end;
+        }
+        part = end + (*end == '/');
+    }
+    while (*name == '/') {
+        ++name;
+    }
+    return (*name != '\0') ? name : path;
+}
+
+//lookup maps
+
+uint64_t name_hash(const char *file_name) {
+    uint64_t hash = HASH64_INIT;
+    hash64(file_name, strlen(file_name), &hash);
+    return hash;
+}
+
+HashMap *build_name_map(Header *header) {
+    //file name hash -> index of the last entry with such name
+    HashMap *map = hashmap_create(header->file_num);
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        hashmap_insert(map, name_hash(header->file[i].name), i);
+    }
+    return map;
+}
+
+int find_file(Header *header, HashMap *name_map, const char *file_name, unsigned *ix) {
+    return hashmap_find(name_map, name_hash(file_name), ix) && !strcmp(header->file[*ix].name, file_name);
+}
+
+unsigned mark_files(Header *header, char *files_to_mark, char **file_names, unsigned file_num) {
+    //returns the number of entries marked; the entries marked already are considered absent
+    HashMap *name_map = build_name_map(header);
+    unsigned file_cnt = 0;
+    for (unsigned i = 0, ix = 0; i < file_num; ++i) {
+        if (find_file(header, name_map, file_names[i], &ix) && !files_to_mark[ix]) {
+            //file was found in the archive
+            files_to_mark[ix] = 1;
+            ++file_cnt;
+        }
+        else {
+            //file was not found
+            print_error("\t<<%s>> was not found in the archive!\n", file_names[i]);
+        }
+    }
+    hashmap_destroy(name_map);
+    return file_cnt;
+}
+
+HashMap *build_dedup_map(Header *header, char *files_to_skip) {
+    //content hash -> index of the first entry with such content
+    HashMap *map = hashmap_create(header->file_num);
+    unsigned ix = 0;
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if ((files_to_skip == NULL || !files_to_skip[i]) && !hashmap_find(map, header->file[i].hash, &ix)) {
+            hashmap_insert(map, header->file[i].hash, i);
+        }
+    }
+    return map;
+}
+
+HashMap *build_size_map(Header *header, char *files_to_skip) {
+    //file size -> index of an entry of such size
+    HashMap *map = hashmap_create(header->file_num);
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (files_to_skip == NULL || !files_to_skip[i]) {
+            hashmap_insert(map, header->file[i].size, i);
+        }
+    }
+    return map;
+}
+
+//append to archive
+
+void discard_data(FILE *temp_file, unsigned file_beg_pos) {
+    //drop the data written to temp_file after file_beg_pos
+    fflush(temp_file);
+    if (ftruncate(fileno(temp_file), file_beg_pos)) {
+        print_error("\tFailed to truncate a temporary file!\n");
+    }
+    file_set_pos(temp_file, file_beg_pos);
+}
+
+typedef struct DataSource {
+    //the archive's data followed by newly compressed data
+    FILE *arch;
+    unsigned data_beg;
+    unsigned data_size;
+    FILE *new_data;
+} DataSource;
+
+void init_data_source(DataSource *src, FILE *arch, FILE *new_data) {
+    //the archive is supposed to be positioned right after the header
+    src->arch = arch;
+    src->data_beg = ftell(arch);
+    fseek(arch, 0, SEEK_END);
+    src->data_size = ftell(arch) - src->data_beg;
+    file_set_pos(arch, src->data_beg);
+    src->new_data = new_data;
+}
+
+void read_data(DataSource *src, unsigned char *data, unsigned data_pos, unsigned size) {
+    //the position of the file read is kept, as it may be written at the same time
+    FILE *from = (data_pos < src->data_size) ? src->arch : src->new_data;
+    unsigned pos = (data_pos < src->data_size) ? src->data_beg + data_pos : data_pos - src->data_size;
+    long saved_pos = ftell(from);
+    file_set_pos(from, pos);
+    if (fread(data, sizeof(char), size, from) != size) {
+        memset(data, 0, size);
+    }
+    fseek(from, saved_pos, SEEK_SET);
+}
+
+unsigned copy_data(DataSource *src, FILE *to, unsigned data_pos, unsigned size) {
+    if (data_pos < src->data_size) {
+        file_set_pos(src->arch, src->data_beg + data_pos);
+        return file_copy_block(src->arch, to, size);
+    }
+    file_set_pos(src->new_data, data_pos - src->data_size);
+    return file_copy_block(src->new_data, to, size);
+}
+
+#define COMPARE_BLOCK_SIZE (1u << 16)
+
+int same_streams(FILE *a, FILE *b) {
+    //1 if the rest of a & of b are the same
+    unsigned char block_a[COMPARE_BLOCK_SIZE], block_b[COMPARE_BLOCK_SIZE];
+    unsigned len_a = 0, len_b = 0;
+    do {
+        len_a = fread(block_a, sizeof(char), COMPARE_BLOCK_SIZE, a);
+        len_b = fread(block_b, sizeof(char), COMPARE_BLOCK_SIZE, b);
+        if (len_a != len_b || memcmp(block_a, block_b, len_a)) {
+            return 0;
+        }
+    } while (len_a == COMPARE_BLOCK_SIZE);
+    return 1;
+}
+
+int same_files(const char *name_a, const char *name_b) {
+    FILE *file_a = fopen(name_a, "rb"), *file_b = fopen(name_b, "rb");
+    int same = (file_a != NULL && file_b != NULL && same_streams(file_a, file_b));
+    file_close(file_a);
+    file_close(file_b);
+    return same;
+}
+
+int same_member_data(DataSource *src, const FileInfo *info, FILE *file_in) {
+    //1 if the stored member decodes to the contents of file_in: the content hash doesn't resist collisions,
+    //so data is shared or kept only after the check byte by byte (streams can't be read again, so they fail it)
+    //the position of file_in is kept; the analysis of the coder is lost
+    struct stat file_stat;
+    if (fstat(fileno(file_in), &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+        (unsigned)file_stat.st_size != info->size) {
+        return 0;
+    }
+    FILE *decoded = tmpfile();
+    if (decoded == NULL) {
+        return 0;
+    }
+    unsigned char *data = (unsigned char*)malloc(info->comp_size + 1);
+    read_data(src, data, info->data_pos, info->comp_size);
+    //the check isn't a part of the coding progress
+    progress_suspend();
+    int same = (decode_memory(data, decoded, info->size, info->comp_size, info->method) == info->crc);
+    progress_resume();
+    free(data);
+    long pos = ftell(file_in);
+    rewind(decoded);
+    rewind(file_in);
+    same = same && same_streams(decoded, file_in);
+    fseek(file_in, pos, SEEK_SET);
+    file_close(decoded);
+    return same;
+}
+
+//compression levels: 1-5 build the code from a sample of 1/32 .. 1/2 of a file, 6 from the whole file,
+//7-9 code by order-1 contexts with up to 4, 8 & 16 code trees
+
+#define DEFAULT_LEVEL 6
+
+unsigned get_level(void) {
+    return (arch_options.level >= 1 && arch_options.level <= 9) ? arch_options.level : DEFAULT_LEVEL;
+}
+
+unsigned get_sample_shift(void) {
+    return (get_level() < DEFAULT_LEVEL) ? DEFAULT_LEVEL - get_level() : 0;
+}
+
+unsigned get_context_clusters(void) {
+    return (get_level() > DEFAULT_LEVEL) ? 1u << (get_level() - DEFAULT_LEVEL + 1) : 0;
+}
+
+unsigned long long get_coding_total(char **file_names, unsigned file_num) {
+    //bytes the coder reads from the files: regular files are read twice (or sampled) unless coded adaptively
+    //(the size of a stream is unknown, so is the total then)
+    unsigned long long total = 0;
+    struct stat file_stat;
+    for (unsigned i = 0; i < file_num; ++i) {
+        if (stat_long_path(file_names[i], &file_stat) != 0) {
+            continue;
+        }
+        if (!S_ISREG(file_stat.st_mode)) {
+            return 0;
+        }
+        total += file_stat.st_size;
+        if (!arch_options.adaptive) {
+            total += get_sample_size(file_stat.st_size, get_sample_shift());
+        }
+    }
+    return total;
+}
+
+void analyze_input(FILE *file_in, FileInfo *info) {
+    //get characters' frequences, long runs of zeros & content hash
+    info->size = get_file_size(file_in);
+    if (get_context_clusters() > 0) {
+        analyze_file_contexts(file_in);
+    }
+    else {
+        analyze_file(file_in);
+    }
+    info->hash = get_file_hash();
+    info->crc = get_file_crc();
+    if (get_zero_run_num() > 0) {
+        info->method = SparseCoding;
+    }
+}
+
+unsigned compress_files(DataSource *src, FILE *temp_file, unsigned base_pos, Header *header, char *files_to_skip,
+                        char **file_names, unsigned file_num) {
+    //returns the number of successfully compressed files
+    //the data position of a new file is base_pos + its position in temp_file
+    //if the coding is cancelled, the files compressed before are kept
+    FILE *file_in = NULL;
+    FileInfo info;
+    struct stat file_stat;
+    unsigned file_cnt = 0, ix = 0;
+    HashMap *dedup_map = build_dedup_map(header, files_to_skip);
+    //a file of a stored size may be a duplicate, so its hash is taken before the coding
+    HashMap *size_map = build_size_map(header, files_to_skip);
+    progress_start(arch_options.progress, arch_options.progress_arg, get_coding_total(file_names, file_num));
+    //compress the requested files
+    for (unsigned i = 0; i < file_num; ++i) {
+        //open an input file
+        if ((file_in = file_open_read(file_names[i]))) {
+            double beg = stats_now();
+            trace_begin("compress", file_names[i]);
+            fstat(fileno(file_in), &file_stat);
+            info.name = (char*)get_member_name(file_names[i]);
+            info.add_time = time(NULL);
+            info.mod_time = file_stat.st_mtime;
+            unsigned file_beg_pos = ftell(temp_file);
+            info.level = get_level();
+            //streams (pipes, sockets, devices) can't be rewound, so they are coded in one pass
+            info.method = (arch_options.adaptive || !S_ISREG(file_stat.st_mode)) ? AdaptiveCoding : StaticCoding;
+            //the content hash of coded data is known after the coding
+            int coded = 0;
+            if (info.method == AdaptiveCoding) {
+                //compress the input file & get its size & content hash
+                info.size = encode_file_adaptive(file_in, temp_file);
+                info.hash = get_file_hash();
+                info.crc = get_file_crc();
+                coded = 1;
+            }
+            else if (get_sample_shift() > 0 && get_sample_size(get_bytes_left(file_in), get_sample_shift()) > 0 &&
+                     !hashmap_find(size_map, get_bytes_left(file_in), &ix)) {
+                //get characters' frequences from a sample, then compress the input file & get its content hash
+                info.size = get_file_size(file_in);
+                analyze_file_sampled(file_in, get_sample_shift());
+                encode_analyzed_file(file_in, temp_file);
+                info.hash = get_file_hash();
+                info.crc = get_file_crc();
+                coded = 1;
+            }
+            else {
+                analyze_input(file_in, &info);
+            }
+            if (progress_cancelled()) {
+                discard_data(temp_file, file_beg_pos);
+                trace_end("compress");
+                file_close(file_in);
+                print_error("\t<<%s>>: cancelled!\n", file_names[i]);
+                break;
+            }
+            int duplicate = hashmap_find(dedup_map, info.hash, &ix) && header->file[ix].size == info.size &&
+                            header->file[ix].crc == info.crc;
+            if (duplicate && !same_member_data(src, &header->file[ix], file_in)) {
+                //a collision of the hashes: the file is coded, so it's analyzed again
+                duplicate = 0;
+                if (!coded) {
+                    analyze_input(file_in, &info);
+                }
+            }
+            if (duplicate) {
+                //the same content is already stored: refer to the existing data
+                if (coded) {
+                    discard_data(temp_file, file_beg_pos);
+                }
+                info.comp_size = header->file[ix].comp_size;
+                info.data_pos = header->file[ix].data_pos;
+                info.method = header->file[ix].method;
+                info.level = header->file[ix].level;
+                header_add_file(header, &info);
+                stats_add_member(file_names[i], beg, info.size, 0);
+                print_msg("\t<<%s>>: added (duplicate of <<%s>>)!\n", file_names[i], header->file[ix].name);
+            }
+            else {
+                //compress the input file
+                if (!coded && get_context_clusters() > 0) {
+                    info.method = encode_analyzed_file_contexts(file_in, temp_file, get_context_clusters());
+                }
+                else if (!coded) {
+                    encode_analyzed_file(file_in, temp_file);
+                }
+                if (progress_cancelled()) {
+                    discard_data(temp_file, file_beg_pos);
+                    trace_end("compress");
+                    file_close(file_in);
+                    print_error("\t<<%s>>: cancelled!\n", file_names[i]);
+                    break;
+                }
+                info.comp_size = ftell(temp_file) - file_beg_pos;
+                info.data_pos = base_pos + file_beg_pos;
+                ix = header_add_file(header, &info);
+                hashmap_insert(dedup_map, info.hash, ix);
+                hashmap_insert(size_map, info.size, ix);
+                stats_add_member(file_names[i], beg, info.size, info.comp_size);
+                print_msg("\t<<%s>>: added!\n", file_names[i]);
+            }
+            //close the input file & change the number of compressed files
+            trace_end("compress");
+            file_close(file_in);
+            ++file_cnt;
+        }
+        else {
+            print_error("\t<<%s>>: failed to open!\n", file_names[i]);
+        }
+    }
+    progress_stop();
+    hashmap_destroy(dedup_map);
+    hashmap_destroy(size_map);
+    return file_cnt;
+}
+
+unsigned append_to_archive(FILE *arch, char **file_names, unsigned file_num) {
+    //read archive's header
+    Header *header = read_header(arch);
+    //open temporary file
+    FILE *temp_file = tmpfile();
+    if (temp_file == NULL) {
+        print_error("\nFailed to add the files to the archive!\n");
+        destroy_header(header);
+        return 0;
+    }
+    //copy the archive's data to the temporary file
+    double beg = stats_now();
+    trace_begin("copy", NULL);
+    unsigned copied = concat_files(temp_file, arch);
+    trace_end("copy");
+    stats_add_phase(PhaseCopy, beg, copied, copied);
+    //compress the requested files
+    //the archive's data & the new data are both in the temporary file
+    DataSource src = {temp_file, 0, UINT_MAX, NULL};
+    unsigned file_cnt = compress_files(&src, temp_file, 0, header, NULL, file_names, file_num);
+    //write the header with the new entries (the directory is coded anew)
+    write_header(arch, header);
+    //rewind the temporary file and concatenate with the archive
+    rewind(temp_file);
+    beg = stats_now();
+    trace_begin("copy", NULL);
+    copied = concat_files(arch, temp_file);
+    trace_end("copy");
+    stats_add_phase(PhaseCopy, beg, copied, copied);
+    //close the temporary file
+    file_close(temp_file);
+    //the new directory may be smaller than the old one
+    fflush(arch);
+    if (ftruncate(fileno(arch), ftell(arch))) {
+        print_error("\tFailed to truncate the archive!\n");
+    }
+    //refresh the checksum
+    refresh_checksum(arch);
+    destroy_header(header);
+    return file_cnt;
+}
+
+//rewrite archive
+
+unsigned write_archive(FILE *temp_file, Header *header, char *files_to_delete, DataSource *src) {
+    //returns the number of files written
+    //assign new data positions: the data shared by duplicates is kept once
+    //(empty data has no position of its own, so it is not mapped)
+    HashMap *pos_map = hashmap_create(header->file_num);
+    unsigned new_pos = 0, data_pos = 0, file_cnt = 0;
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (!files_to_delete[i] && header->file[i].comp_size > 0 &&
+            !hashmap_find(pos_map, header->file[i].data_pos, &data_pos)) {
+            hashmap_insert(pos_map, header->file[i].data_pos, new_pos);
+            new_pos += header->file[i].comp_size;
+        }
+    }
+    //write header (the entries share the names with the old header)
+    Header new_header = {0};
+    header_reserve(&new_header, header->file_num + 1);
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (!files_to_delete[i]) {
+            FileInfo *info = &new_header.file[new_header.file_num++];
+            *info = header->file[i];
+            info->data_pos = 0;
+            hashmap_find(pos_map, header->file[i].data_pos, &info->data_pos);
+        }
+    }
+    file_cnt = new_header.file_num;
+    write_header(temp_file, &new_header);
+    free(new_header.file);
+    //write the files except from deleted
+    double beg = stats_now();
+    unsigned copied = 0;
+    trace_begin("copy", NULL);
+    new_pos = 0;
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (files_to_delete[i] || header->file[i].comp_size == 0) {
+            continue;
+        }
+        hashmap_find(pos_map, header->file[i].data_pos, &data_pos);
+        if (data_pos == new_pos) {
+            //the first reference to the data: copy it
+            copied += copy_data(src, temp_file, header->file[i].data_pos, header->file[i].comp_size);
+            new_pos += header->file[i].comp_size;
+        }
+    }
+    trace_end("copy");
+    stats_add_phase(PhaseCopy, beg, copied, copied);
+    hashmap_destroy(pos_map);
+    //refresh the checksum
+    refresh_checksum(temp_file);
+    return file_cnt;
+}
+
+void replace_archive(FILE *arch, FILE *temp_file) {
+    //overwrite the archive with the temporary file's contents
+    rewind(temp_file);
+    rewind(arch);
+    double beg = stats_now();
+    trace_begin("copy", NULL);
+    unsigned copied = concat_files(arch, temp_file);
+    trace_end("copy");
+    stats_add_phase(PhaseCopy, beg, copied, copied);
+    fflush(arch);
+    if (ftruncate(fileno(arch), ftell(arch))) {
+        print_error("\tFailed to truncate the archive!\n");
+    }
+}
+
+//update archive
+
+int file_is_changed(DataSource *src, FileInfo *info, char *file_name, struct stat *file_stat, int compare_hash) {
+    if (!S_ISREG(file_stat->st_mode) || (unsigned)file_stat->st_size != info->size) {
+        //a stream is always considered changed
+        return 1;
+    }
+    if (!compare_hash) {
+        return file_stat->st_mtime != info->mod_time;
+    }
+    //compare the contents
+    FILE *file_in = file_open_read(file_name);
+    if (file_in == NULL) {
+        return 1;
+    }
+    analyze_file(file_in);
+    int changed = (get_file_hash() != info->hash || get_file_crc() != info->crc ||
+                   !same_member_data(src, info, file_in));
+    file_close(file_in);
+    return changed;
+}
+
+unsigned find_changed_files(DataSource *src, Header *header, char *files_to_delete, char **file_names, unsigned file_num,
+                            int compare_hash, char **changed_files, int *dir_changed) {
+    //returns the number of files to compress; the entries they replace are marked in files_to_delete
+    //(entries marked already are considered absent), the modification time of unchanged files is refreshed
+    HashMap *name_map = build_name_map(header);
+    unsigned changed_num = 0, ix = 0;
+    struct stat file_stat;
+    for (unsigned i = 0; i < file_num; ++i) {
+        if (stat_long_path(file_names[i], &file_stat) != 0) {
+            print_error("\t<<%s>>: failed to open!\n", file_names[i]);
+        }
+        else if (!find_file(header, name_map, get_member_name(file_names[i]), &ix) || files_to_delete[ix]) {
+            //a new file
+            changed_files[changed_num++] = file_names[i];
+        }
+        else if (file_is_changed(src, &header->file[ix], file_names[i], &file_stat, compare_hash)) {
+            //replace the stored file
+            files_to_delete[ix] = 1;
+            changed_files[changed_num++] = file_names[i];
+        }
+        else {
+            if (header->file[ix].mod_time != file_stat.st_mtime) {
+                //the same contents: refresh the modification time only
+                header->file[ix].mod_time = file_stat.st_mtime;
+                *dir_changed = 1;
+            }
+            print_msg("\t<<%s>>: up to date!\n", file_names[i]);
+        }
+    }
+    hashmap_destroy(name_map);
+    return changed_num;
+}
+
+unsigned update_archive(FILE *arch, char **file_names, unsigned file_num, int compare_hash) {
+    //read archive's header
+    Header *header = read_header(arch);
+    unsigned old_num = header->file_num;
+    //old entries to replace & files to compress
+    char *files_to_delete = (char*)calloc(old_num + file_num, sizeof(char));
+    char **changed_files = (char**)calloc(file_num, sizeof(char*));
+    int dir_changed = 0;
+    //the stored data of the files is compared with their contents
+    DataSource src;
+    init_data_source(&src, arch, NULL);
+    unsigned changed_num = find_changed_files(&src, header, files_to_delete, file_names, file_num, compare_hash,
+                                              changed_files, &dir_changed);
+    unsigned file_cnt = 0;
+    FILE *data_file = NULL, *temp_file = NULL;
+    if (changed_num == 0 && !dir_changed) {
+        //nothing to rewrite
+        goto free_resources;
+    }
+    data_file = tmpfile();
+    temp_file = tmpfile();
+    if (data_file == NULL || temp_file == NULL) {
+        print_error("\tFailed to update the archive!\n");
+        goto free_resources;
+    }
+    //compress changed files after the archive's data
+    src.new_data = data_file;
+    file_cnt = compress_files(&src, data_file, src.data_size, header, files_to_delete, changed_files, changed_num);
+    if (progress_cancelled()) {
+        //the replaced entries are still needed: the archive is left as it is
+        file_cnt = 0;
+        goto free_resources;
+    }
+    //write the updated archive & replace the old one
+    write_archive(temp_file, header, files_to_delete, &src);
+    replace_archive(arch, temp_file);
+
+    free_resources:
+    file_close(data_file);
+    file_close(temp_file);
+    free(changed_files);
+    free(files_to_delete);
+    destroy_header(header);
+    return file_cnt;
+}
+
+//create archive
+
+int create_archive(const char *arch_name) {
+    //open a file
+    FILE *arch = fopen(arch_name, "wb+");
+    if (arch == NULL) {
+        return 1;
+    }
+    //write file signature & zero checksum & an empty directory
+    Header header = {0};
+    write_header(arch, &header);
+    //refresh the checksum
+    refresh_checksum(arch);
+    //close the file
+    file_close(arch);
+    return 0;
+}
+
+//extract
+
+#define FILENAME_LEN 256
+
+char strbuf[FILENAME_LEN] = {0};
+
+char *make_file_name(const char *format, ...) {
+    va_list argptr;
+    va_start(argptr, format);
+    vsnprintf(strbuf, FILENAME_LEN, format, argptr);
+    va_end(argptr);
+    return strbuf;
+}
+
+
+//small members are decoded to memory & written in batches through io_uring (see uring_writer.h),
+//the files the batches fail to write are written by stdio
+
+#define SMALL_MEMBER_SIZE (64u << 10)
+#define SMALL_ARENA_SIZE (4u << 20)
+
+typedef struct SmallMember {
+    unsigned ix;
+    unsigned offset;
+    uint32_t crc;
+    double beg;
+    uint64_t name_hash;
+} SmallMember;
+
+typedef struct SmallBatch {
+    UringWriter *writer;
+    //the decoded data of the batch
+    unsigned char *arena;
+    FILE *arena_file;
+    unsigned used;
+    SmallMember member[URING_BATCH_FILES];
+    unsigned member_num;
+    //the directory made last (the members are sorted by name)
+    const char *last_dir;
+    unsigned last_dir_len;
+} SmallBatch;
+
+//members written by the batches of the last extraction
+
+unsigned batched_member_num = 0;
+
+unsigned get_batched_member_num(void) {
+    return batched_member_num;
+}
+
+int open_small_batch(SmallBatch *batch) {
+    //returns 0 if the members are to be extracted one by one
+    memset(batch, 0, sizeof(SmallBatch));
+    //the files are created by the kernel's workers: that pays off only if they run beside the decoding,
+    //so the batches are asked for
+    if (!arch_options.uring || (batch->writer = uring_writer_open()) == NULL) {
+        return 0;
+    }
+    batch->arena = (unsigned char*)malloc(SMALL_ARENA_SIZE);
+    batch->arena_file = fmemopen(batch->arena, SMALL_ARENA_SIZE, "w");
+    if (batch->arena_file == NULL) {
+        free(batch->arena);
+        uring_writer_close(batch->writer);
+        batch->writer = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void close_small_batch(SmallBatch *batch) {
+    if (batch->writer != NULL) {
+        file_close(batch->arena_file);
+        free(batch->arena);
+        uring_writer_close(batch->writer);
+    }
+}
+
+int is_queued_name(const Header *header, const SmallBatch *batch, const char *file_name) {
+    //the files of a batch are written in no particular order, so an entry of a queued name is written after the batch
+    uint64_t hash = (batch->member_num > 0) ? name_hash(file_name) : 0;
+    for (unsigned i = 0; i < batch->member_num; ++i) {
+        if (batch->member[i].name_hash == hash && !strcmp(header->file[batch->member[i].ix].name, file_name)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int is_small_member(const SmallBatch *batch, const FileInfo *info) {
+    //sparse members are written with holes, so they aren't batched
+    return batch->writer != NULL && info->size <= SMALL_MEMBER_SIZE && info->method != SparseCoding;
+}
+
+int report_member(const FileInfo *info, uint32_t crc, double beg) {
+    //returns 1 if the member is extracted intact
+    if (crc != info->crc) {
+        print_error("\t<<%s>>: extracted, but the checksum doesn't match!\n", info->name);
+        return 0;
+    }
+    stats_add_member(info->name, beg, info->comp_size, info->size);
+    print_msg("\t<<%s>>: extracted!\n", info->name);
+    return 1;
+}
+
+int write_member_data(const char *file_name, const unsigned char *data, unsigned size) {
+    //returns 0 if the file can't be written
+    FILE *file = file_create(file_name, size);
+    if (file == NULL) {
+        return 0;
+    }
+    int ok = (fwrite(data, sizeof(char), size, file) == size);
+    return (fclose(file) == 0) && ok;
+}
+
+unsigned flush_small_batch(const Header *header, SmallBatch *batch) {
+    //returns the number of members extracted
+    const int *result = NULL;
+    unsigned member_num = uring_writer_submit(batch->writer, &result), file_cnt = 0;
+    for (unsigned i = 0; i < member_num; ++i) {
+        const SmallMember *member = &batch->member[i];
+        const FileInfo *info = &header->file[member->ix];
+        if (result[i] != 0 && !write_member_data(info->name, batch->arena + member->offset, info->size)) {
+            print_error("\t<<%s>>: failed!\n", info->name);
+        }
+        else {
+            batched_member_num += (result[i] == 0);
+            file_cnt += report_member(info, member->crc, member->beg);
+        }
+    }
+    batch->member_num = 0;
+    batch->used = 0;
+    rewind(batch->arena_file);
+    return file_cnt;
+}
+
+void make_member_dir(SmallBatch *batch, const char *file_name) {
+    //the openat of a batch doesn't make directories: the member's directory is made beforehand
+    const char *sep = strrchr(file_name, '/');
+    unsigned dir_len = (sep != NULL) ? (unsigned)(sep - file_name) : 0;
+    if (dir_len == 0 || (dir_len == batch->last_dir_len && !memcmp(file_name, batch->last_dir, dir_len))) {
+        return;
+    }
+    make_parent_dirs(file_name);
+    batch->last_dir = file_name;
+    batch->last_dir_len = dir_len;
+}
+
+unsigned extract_small_member(const ArchiveView *view, SmallBatch *batch, unsigned ix) {
+    //decodes the member to the batch; returns the number of members extracted by flushing the batch
+    const FileInfo *info = &view->header->file[ix];
+    unsigned file_cnt = 0;
+    if (batch->member_num == URING_BATCH_FILES || batch->used + info->size > SMALL_ARENA_SIZE) {
+        file_cnt = flush_small_batch(view->header, batch);
+    }
+    double beg = stats_now();
+    trace_begin("extract", info->name);
+    SmallMember *member = &batch->member[batch->member_num];
+    member->ix = ix;
+    member->offset = batch->used;
+    member->beg = beg;
+    member->name_hash = name_hash(info->name);
+    member->crc = decode_member(view, batch->arena_file, info);
+    fflush(batch->arena_file);
+    if (progress_cancelled()) {
+        //nothing is written yet
+        print_error("\t<<%s>>: cancelled!\n", info->name);
+        fseek(batch->arena_file, batch->used, SEEK_SET);
+        trace_end("extract");
+        return file_cnt;
+    }
+    make_member_dir(batch, info->name);
+    if (uring_writer_add(batch->writer, info->name, batch->arena + batch->used, info->size)) {
+        ++batch->member_num;
+        batch->used += info->size;
+    }
+    else if (!write_member_data(info->name, batch->arena + batch->used, info->size)) {
+        //the ring failed: the member is written by stdio
+        print_error("\t<<%s>>: failed!\n", info->name);
+    }
+    else {
+        file_cnt += report_member(info, member->crc, beg);
+    }
+    //the next member is decoded after this one (the stream is ahead of it if this one isn't queued)
+    fseek(batch->arena_file, batch->used, SEEK_SET);
+    trace_end("extract");
+    return file_cnt;
+}
+
+int is_safe_path(const char *file_name) {
+    //members are extracted below the current directory only: absolute paths & ".." components are refused
+    if (file_name[0] == '\0' || file_name[0] == '/') {
+        return 0;
+    }
+    for (const char *part = file_name; part != NULL; part = strchr(part, '/')) {
+        part += (*part == '/');
+        if (part[0] == '.' && part[1] == '.' && (part[2] == '/' || part[2] == '\0')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+unsigned extract_files(const ArchiveView *view, char *files_to_extract) {
+    Header *header = view->header;
+    FILE *file = NULL;
+    unsigned file_cnt = 0;
+    unsigned long long total = 0;
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        total += files_to_extract[i] ? header->file[i].comp_size : 0;
+    }
+    SmallBatch batch;
+    open_small_batch(&batch);
+    batched_member_num = 0;
+    progress_start(arch_options.progress, arch_options.progress_arg, total);
+    for (unsigned i = 0; i < header->file_num && !progress_cancelled(); ++i) {
+        if (files_to_extract[i] && is_queued_name(header, &batch, header->file[i].name)) {
+            //an older entry of the name is written first
+            file_cnt += flush_small_batch(header, &batch);
+        }
+        if (files_to_extract[i] && !is_safe_path(header->file[i].name)) {
+            print_error("\t<<%s>>: the path leads out of the directory, not extracted!\n", header->file[i].name);
+        }
+        else if (files_to_extract[i] && is_small_member(&batch, &header->file[i])) {
+            prefetch_member(view, &header->file[i]);
+            file_cnt += extract_small_member(view, &batch, i);
+        }
+        else if (files_to_extract[i]) {
+            double beg = stats_now();
+            trace_begin("extract", header->file[i].name);
+            prefetch_member(view, &header->file[i]);
+            //a sparse member isn't preallocated: its holes would be allocated only to be punched out again
+            file = file_create(header->file[i].name,
+                               (header->file[i].method == SparseCoding) ? 0 : header->file[i].size);
+            if (file == NULL) {
+                print_error("\t<<%s>>: failed!\n", header->file[i].name);
+                trace_end("extract");
+                continue;
+            }
+            uint32_t crc = decode_member(view, file, &header->file[i]);
+            file_close(file);
+            if (progress_cancelled()) {
+                //a partially extracted file is removed
+                remove(header->file[i].name);
+                print_error("\t<<%s>>: cancelled!\n", header->file[i].name);
+            }
+            else {
+                file_cnt += report_member(&header->file[i], crc, beg);
+            }
+            trace_end("extract");
+        }
+    }
+    //the decoded members are written even if the extraction is cancelled
+    if (batch.member_num > 0) {
+        file_cnt += flush_small_batch(header, &batch);
+    }
+    close_small_batch(&batch);
+    progress_stop();
+    return file_cnt;
+}
+
+
+unsigned extract_from_archive(const ArchiveView *view, char **file_names, unsigned file_num) {
+    Header *header = view->header;
+    //files to extract (on the heap: a directory may have millions of entries)
+    char *files_to_extract = (char*)calloc(header->file_num + 1, sizeof(char));
+    //find files to extract
+    mark_files(header, files_to_extract, file_names, file_num);
+    //extract files
+    unsigned file_cnt = extract_files(view, files_to_extract);
+    free(files_to_extract);
+    return file_cnt;
+}
+
+unsigned cat_members(const ArchiveView *view, char **file_names, unsigned file_num, int fd) {
+    //decode the members one after another to the descriptor; returns the number of members written
+    Header *header = view->header;
+    FILE *out = file_open_fd(fd);
+    if (out == NULL) {
+        print_error("\tFailed to open the output!\n");
+        return 0;
+    }
+    HashMap *name_map = build_name_map(header);
+    unsigned file_cnt = 0, ix = 0;
+    unsigned long long total = 0;
+    for (unsigned i = 0; i < file_num; ++i) {
+        total += find_file(header, name_map, file_names[i], &ix) ? header->file[ix].comp_size : 0;
+    }
+    progress_start(arch_options.progress, arch_options.progress_arg, total);
+    for (unsigned i = 0; i < file_num && !progress_cancelled(); ++i) {
+        if (!find_file(header, name_map, file_names[i], &ix)) {
+            print_error("\t<<%s>> was not found in the archive!\n", file_names[i]);
+            continue;
+        }
+        FileInfo *info = &header->file[ix];
+        double beg = stats_now();
+        trace_begin("cat", info->name);
+        prefetch_member(view, info);
+        uint32_t crc = decode_member(view, out, info);
+        //the data is flushed before the next member, so a reader sees whole members
+        fflush(out);
+        if (progress_cancelled()) {
+            print_error("\t<<%s>>: cancelled!\n", info->name);
+        }
+        else if (crc != info->crc) {
+            print_error("\t<<%s>>: written, but the checksum doesn't match!\n", info->name);
+        }
+        else {
+            ++file_cnt;
+            stats_add_member(info->name, beg, info->comp_size, info->size);
+        }
+        trace_end("cat");
+    }
+    progress_stop();
+    hashmap_destroy(name_map);
+    file_close(out);
+    return file_cnt;
+}
+
+unsigned extract_all(const ArchiveView *view) {
+    Header *header = view->header;
+    //files to extract
+    char *files_to_extract = (char*)malloc(header->file_num + 1);
+    memset(files_to_extract, 1, header->file_num);
+    //extract files
+    unsigned file_cnt = extract_files(view, files_to_extract);
+    free(files_to_extract);
+    return file_cnt;
+}
+
+//remove from archive
+
+unsigned delete_files(FILE *arch, Header *header, char *files_to_delete) {
+    //open temporary file
+    FILE *temp_file = tmpfile();
+    if (temp_file == NULL) {
+        print_error("\tFailed to delete files from the archive!\n");
+        return 0;
+    }
+    //write the archive without deleted files
+    trace_begin("delete", NULL);
+    DataSource src;
+    init_data_source(&src, arch, NULL);
+    unsigned file_cnt = header->file_num - write_archive(temp_file, header, files_to_delete, &src);
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (files_to_delete[i]) {
+            print_msg("\t<<%s>>: deleted!\n", header->file[i].name);
+        }
+    }
+    //write the temporary file to the archive
+    replace_archive(arch, temp_file);
+    file_close(temp_file);
+    trace_end("delete");
+    return file_cnt;
+}
+
+unsigned remove_from_archive(FILE *arch, char **file_names, unsigned file_num) {
+    //read archive header
+    Header *header = read_header(arch);
+    //files to delete
+    char *files_to_delete = (char*)calloc(header->file_num + 1, sizeof(char));
+    mark_files(header, files_to_delete, file_names, file_num);
+    unsigned file_cnt = delete_files(arch, header, files_to_delete);
+    free(files_to_delete);
+    destroy_header(header);
+    return file_cnt;
+}
+
+unsigned remove_all(FILE *arch) {
+    Header *header = read_header(arch);
+    char *files_to_delete = (char*)malloc(header->file_num + 1);
+    memset(files_to_delete, 1, header->file_num);
+    unsigned file_cnt = delete_files(arch, header, files_to_delete);
+    free(files_to_delete);
+    destroy_header(header);
+    return file_cnt;
+}
+
+//print archive information
+
+void print_arch_info(const ArchiveView *view, char *arch_name) {
+    Header *file_header = view->header;
+    //print name
+    print_msg("\n\t>>Archive name: <<%s>>\n", arch_name);
+    //print checksum
+    print_msg("\n\t>>Header checksum: 0x%08X\n", file_header->checksum);
+    //print number of files
+    print_msg("\n\t>>Number of files: %u\n", file_header->file_num);
+    //print file info
+    if (file_header->file_num > 0) {
+        print_msg("\n\t\t***File list***\n\n");
+    }
+    for (unsigned i = 0; i < file_header->file_num; ++i) {
+        FileInfo *info = &file_header->file[i];
+        //file name
+        print_msg("\t<<%s>>\n", info->name);
+        //file size
+        print_msg("\t*File size: %u bytes\n", info->size);
+        //compressed file size
+        print_msg("\t*Compressed file size: %u bytes\n", info->comp_size);
+        //compression ratio
+        print_msg("\t*Compression: %d%%\n", (info->comp_size >= info->size) ?
+                    0 : (int)((1.0 - (double)info->comp_size / info->size) * 100.0));
+        //coding method
+        print_msg("\t*Level: %u\n", info->level);
+        print_msg("\t*Coding: %s\n", (info->method == AdaptiveCoding) ? "adaptive" :
+                                      (info->method == SparseCoding) ? "static, zero runs" :
+                                      (info->method == ContextCoding) ? "static, order-1 contexts" : "static");
+        //modification time
+        print_msg("\t*Modification time: %s", ctime(&info->mod_time));
+        //add time
+        print_msg("\t*Add time: %s\n", ctime(&info->add_time));
+    }
+}
+
+//check archive's integrity
+
+int check_header_checksum(FILE *arch) {
+    //read checksum
+    uint32_t checksum = read_checksum(arch);
+    //get checksum & compare
+    return checksum == get_header_checksum(arch);
+}
+
+//verify members
+
+typedef struct VerifyJob {
+    //the workers decode the mapped archive in place
+    const ArchiveView *view;
+    //entries with distinct data, the largest first
+    unsigned *file_ix;
+    char *failed;
+} VerifyJob;
+
+static int cmp_comp_size(const void *a, const void *b) {
+    unsigned size_a = sort_header->file[*(const unsigned*)a].comp_size;
+    unsigned size_b = sort_header->file[*(const unsigned*)b].comp_size;
+    return (size_a < size_b) - (size_a > size_b);
+}
+
+void verify_task(unsigned task_ix, unsigned worker_ix, void *arg) {
+    VerifyJob *job = (VerifyJob*)arg;
+    (void)worker_ix;
+    FileInfo *info = &job->view->header->file[job->file_ix[task_ix]];
+    if (progress_cancelled()) {
+        //the rest of the tasks are skipped
+        return;
+    }
+    //decode to a null sink & compare the checksums
+    double beg = stats_now();
+    trace_begin("verify", info->name);
+    prefetch_member(job->view, info);
+    job->failed[task_ix] = member_data(job->view, info) == NULL ||
+                           (decode_member(job->view, NULL, info) != info->crc && !progress_cancelled());
+    trace_end("verify");
+    stats_add_member(info->name, beg, info->comp_size, 0);
+}
+
+unsigned verify_archive(const ArchiveView *view) {
+    //returns the number of corrupted files
+    Header *header = view->header;
+    VerifyJob job = {.view = view};
+    //the data shared by duplicates is decoded once
+    HashMap *pos_map = hashmap_create(header->file_num);
+    job.file_ix = (unsigned*)calloc(header->file_num + 1, sizeof(int));
+    unsigned task_num = 0, task_ix = 0;
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (header->file[i].size > 0 && !hashmap_find(pos_map, header->file[i].data_pos, &task_ix)) {
+            hashmap_insert(pos_map, header->file[i].data_pos, task_num);
+            job.file_ix[task_num++] = i;
+        }
+    }
+    sort_header = header;
+    qsort(job.file_ix, task_num, sizeof(int), cmp_comp_size);
+    for (unsigned i = 0; i < task_num; ++i) {
+        hashmap_insert(pos_map, header->file[job.file_ix[i]].data_pos, i);
+    }
+    //decode all the members in parallel
+    unsigned long long total = 0;
+    for (unsigned i = 0; i < task_num; ++i) {
+        total += header->file[job.file_ix[i]].comp_size;
+    }
+    progress_start(arch_options.progress, arch_options.progress_arg, total);
+    job.failed = (char*)calloc(task_num + 1, sizeof(char));
+    parallel_for(task_num, verify_task, &job);
+    progress_stop();
+    //report corrupted files
+    unsigned file_cnt = 0;
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (header->file[i].size > 0 && hashmap_find(pos_map, header->file[i].data_pos, &task_ix) &&
+            job.failed[task_ix]) {
+            print_error("\t<<%s>>: the checksum doesn't match!\n", header->file[i].name);
+            ++file_cnt;
+        }
+    }
+    hashmap_destroy(pos_map);
+    free(job.file_ix);
+    free(job.failed);
+    return file_cnt;
+}
+
+//read-only operations on the mapped archive
+
+int open_view(FILE *arch, char *arch_name, ArchiveView *view) {
+    //returns 0 if the archive can't be read (the error is printed)
+    //only the index of the directory is parsed: the header is decoded by load_view()
+    view->header = NULL;
+    view->dir.block = NULL;
+    view->new_beg = UINT_MAX;
+    memset(&view->new_map, 0, sizeof(FileMap));
+    if (!file_map(arch, &view->map)) {
+        print_error("\tFailed to read <<%s>>!\n", arch_name);
+        return 0;
+    }
+    if (view->map.size < sizeof(magic_num) - 1 || memcmp(view->map.data, magic_num, sizeof(magic_num) - 1)) {
+        print_error("\tThe file <<%s>> is not an archive!\n", arch_name);
+        return 0;
+    }
+    unsigned file_num = 0, dir_size = 0;
+    uint32_t version = 0, stored_checksum = 0, checksum = 0;
+    if (view->map.size >= DIRECTORY_FILEPOS) {
+        memcpy(&version, view->map.data + VERSION_FILEPOS, sizeof(uint32_t));
+        if (version != FORMAT_VERSION) {
+            print_error("\tThe archive <<%s>> has an unsupported format version (%u)!\n", arch_name, version);
+            return 0;
+        }
+    }
+    int ok = (view->map.size >= DIRECTORY_FILEPOS);
+    if (ok) {
+        memcpy(&stored_checksum, view->map.data + CHECKSUM_FILEPOS, sizeof(uint32_t));
+        memcpy(&file_num, view->map.data + FILE_NUM_FILEPOS, sizeof(int));
+        memcpy(&dir_size, view->map.data + DIR_SIZE_FILEPOS, sizeof(int));
+        ok = (dir_size <= view->map.size - DIRECTORY_FILEPOS);
+    }
+    //only the header is checked here: reading a part of an archive doesn't read the whole archive
+    if (ok) {
+        view->data_beg = DIRECTORY_FILEPOS + dir_size;
+        view->new_beg = view->map.size - view->data_beg;
+        double beg = stats_now();
+        trace_begin("checksum", NULL);
+        crc32(view->map.data + FILE_NUM_FILEPOS, view->data_beg - FILE_NUM_FILEPOS, &checksum);
+        trace_end("checksum");
+        stats_add_phase(PhaseChecksum, beg, view->data_beg - FILE_NUM_FILEPOS, 0);
+        ok = (checksum == stored_checksum) &&
+             map_directory(view->map.data + DIRECTORY_FILEPOS, dir_size, file_num, &view->dir);
+    }
+    if (!ok) {
+        print_error("\tThe archive <<%s>> is corrupted!\n", arch_name);
+    }
+    return ok;
+}
+
+void header_clear(Header *file_header) {
+    for (unsigned i = 0; i < file_header->file_num; ++i) {
+        free(file_header->file[i].name);
+    }
+    file_header->file_num = 0;
+}
+
+typedef struct NameQuery {
+    unsigned block_ix;
+    const char *name;
+} NameQuery;
+
+static int cmp_queries(const void *a, const void *b) {
+    const NameQuery *query_a = (const NameQuery*)a, *query_b = (const NameQuery*)b;
+    if (query_a->block_ix != query_b->block_ix) {
+        return (query_a->block_ix > query_b->block_ix) - (query_a->block_ix < query_b->block_ix);
+    }
+    return strcmp(query_a->name, query_b->name);
+}
+
+Header *load_files(const Directory *dir, const unsigned char *prefix, char **file_names, unsigned file_num) {
+    //the header of the last entries of the names: only the blocks with the names are decoded
+    //(the names not found are left out); returns NULL if a block is corrupted
+    Header *file_header = (Header*)calloc(1, sizeof(Header));
+    memcpy(file_header->file_signature, prefix + MAGIC_NUM_FILEPOS, sizeof(magic_num) - 1);
+    memcpy(&file_header->checksum, prefix + CHECKSUM_FILEPOS, sizeof(uint32_t));
+    double beg = stats_now();
+    trace_begin("directory", NULL);
+    //the names are grouped by block, so every block is decoded once
+    NameQuery *query = (NameQuery*)malloc((file_num + 1) * sizeof(NameQuery));
+    unsigned query_num = 0, decoded = 0;
+    for (unsigned i = 0; i < file_num; ++i) {
+        if (find_block(dir, file_names[i], &query[query_num].block_ix)) {
+            query[query_num++].name = file_names[i];
+        }
+    }
+    qsort(query, query_num, sizeof(NameQuery), cmp_queries);
+    Header *block_header = (Header*)calloc(1, sizeof(Header));
+    int ok = 1;
+    for (unsigned i = 0; i < query_num && ok; ++i) {
+        int same_block = (i > 0 && query[i].block_ix == query[i - 1].block_ix);
+        if (same_block && !strcmp(query[i].name, query[i - 1].name)) {
+            continue;
+        }
+        if (!same_block) {
+            header_clear(block_header);
+            ok = decode_block(dir, query[i].block_ix, block_header);
+            decoded += dir->block[query[i].block_ix].comp_size;
+        }
+        //the entries are sorted: the last one of the name is right before the first one after it
+        unsigned lo = 0, hi = block_header->file_num;
+        while (lo < hi) {
+            unsigned mid = lo + (hi - lo) / 2;
+            if (strcmp(block_header->file[mid].name, query[i].name) <= 0) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        if (ok && lo > 0 && !strcmp(block_header->file[lo - 1].name, query[i].name)) {
+            header_add_file(file_header, &block_header->file[lo - 1]);
+        }
+    }
+    destroy_header(block_header);
+    free(query);
+    trace_end("directory");
+    stats_add_phase(PhaseDirectory, beg, decoded, 0);
+    if (!ok) {
+        destroy_header(file_header);
+        return NULL;
+    }
+    return file_header;
+}
+
+int load_view(ArchiveView *view, char *arch_name, char **file_names, unsigned file_num) {
+    //decodes the entries of the names, or all of them if file_names is NULL; returns 0 if the directory is corrupted
+    view->header = (file_names != NULL) ? load_files(&view->dir, view->map.data, file_names, file_num) :
+                                          load_header(&view->dir, view->map.data);
+    if (view->header == NULL) {
+        print_error("\tThe archive <<%s>> is corrupted!\n", arch_name);
+    }
+    return view->header != NULL;
+}
+
+void close_view(ArchiveView *view) {
+    destroy_header(view->header);
+    free(view->dir.block);
+    file_unmap(&view->map);
+    file_unmap(&view->new_map);
+}
+
+int is_read_only(MenuOption opt) {
+    //listing, extraction & checking only read the archive
+    return opt == ExtractFromArchive || opt == ExtractAll || opt == CheckIntegrity || opt == PrintInfo ||
+           opt == CatMembers;
+}
+
+void run_view_option(const ArchiveView *view, char *arch_name, char **file_names, unsigned file_num,
+                     MenuOption opt) {
+    switch (opt) {
+        case ExtractFromArchive:
+            print_msg("\tFiles extracted: %u\n",
+                       extract_from_archive(view, file_names, file_num));
+            break;
+        case ExtractAll:
+            print_msg("\tFiles extracted: %u\n",
+                       extract_all(view));
+            break;
+        case CheckIntegrity:
+            if (verify_archive(view) > 0) {
+                print_error("\tThe archive <<%s>> is corrupted!\n", arch_name);
+            }
+            else if (progress_cancelled()) {
+                print_error("\tThe check of <<%s>> was cancelled!\n", arch_name);
+            }
+            else {
+                print_msg("\tThe archive <<%s>> is OK!\n", arch_name);
+            }
+            break;
+        case PrintInfo:
+            print_arch_info(view, arch_name);
+            break;
+        case CatMembers:
+            print_msg("\tFiles written: %u\n",
+                      cat_members(view, file_names, file_num, arch_options.cat_fd ? arch_options.cat_fd : STDOUT_FILENO));
+            break;
+        default:
+            print_error("Invalid option!\n");
+            break;
+    }
+}
+
+void view_menu(FILE *arch, char *arch_name, char **file_names, unsigned file_num, MenuOption opt) {
+    ArchiveView view;
+    //the members named are looked up in the directory without decoding all of it
+    int lookup = (opt == ExtractFromArchive || opt == CatMembers);
+    if (open_view(arch, arch_name, &view) && load_view(&view, arch_name, lookup ? file_names : NULL, file_num)) {
+        run_view_option(&view, arch_name, file_names, file_num, opt);
+    }
+    close_view(&view);
+}
+
+//options of the operation
+
+void start_menu(const ArchiverOptions *options, FILE *out) {
+    arch_options = *options;
+    msg_out = out;
+    stats_enable(arch_options.stats != NoStats);
+    if (arch_options.trace_file != NULL && !trace_open(arch_options.trace_file)) {
+        print_error("\tFailed to create the trace file <<%s>>!\n", arch_options.trace_file);
+    }
+}
+
+void finish_menu(void) {
+    stats_print((msg_out != NULL) ? msg_out : stdout, arch_options.stats == StatsJson);
+    trace_close();
+}
+
+//estimate the compression
+
+typedef struct EstimateJob {
+    char **file_names;
+    //sizes, coded sizes, content hashes, checksums, coding methods & modification times of the files
+    unsigned *size;
+    unsigned *comp_size;
+    uint64_t *hash;
+    uint32_t *crc;
+    unsigned char *method;
+    time_t *mod_time;
+    //1 if the file is estimated
+    char *done;
+} EstimateJob;
+
+void estimate_task(unsigned task_ix, unsigned worker_ix, void *arg) {
+    EstimateJob *job = (EstimateJob*)arg;
+    (void)worker_ix;
+    char *file_name = job->file_names[task_ix];
+    struct stat file_stat;
+    FILE *file_in = file_open_read(file_name);
+    //the size of a stream is known after it's read, so streams aren't estimated
+    if (file_in == NULL || fstat(fileno(file_in), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        file_close(file_in);
+        return;
+    }
+    //only the histogram is read: the size follows from the code lengths
+    double beg = stats_now();
+    trace_begin("estimate", file_name);
+    job->size[task_ix] = get_file_size(file_in);
+    job->mod_time[task_ix] = file_stat.st_mtime;
+    if (get_context_clusters() > 0) {
+        analyze_file_contexts(file_in);
+    }
+    else {
+        analyze_file(file_in);
+    }
+    job->hash[task_ix] = get_file_hash();
+    job->crc[task_ix] = get_file_crc();
+    job->comp_size[task_ix] = get_coded_size();
+    job->method[task_ix] = (get_zero_run_num() > 0) ? SparseCoding : StaticCoding;
+    unsigned context_size = (get_context_clusters() > 0) ? get_context_coded_size(get_context_clusters()) : UINT_MAX;
+    if (context_size < job->comp_size[task_ix]) {
+        job->comp_size[task_ix] = context_size;
+        job->method[task_ix] = ContextCoding;
+    }
+    job->done[task_ix] = 1;
+    trace_end("estimate");
+    stats_add_member(file_name, beg, job->size[task_ix], job->comp_size[task_ix]);
+    file_close(file_in);
+}
+
+unsigned estimate_files(char **file_names, unsigned file_num) {
+    //prints the archive size the files would take when coded statically
+    //returns the number of estimated files
+    EstimateJob job = {.file_names = file_names};
+    job.size = (unsigned*)calloc(file_num + 1, sizeof(int));
+    job.comp_size = (unsigned*)calloc(file_num + 1, sizeof(int));
+    job.hash = (uint64_t*)calloc(file_num + 1, sizeof(uint64_t));
+    job.crc = (uint32_t*)calloc(file_num + 1, sizeof(uint32_t));
+    job.method = (unsigned char*)calloc(file_num + 1, sizeof(char));
+    job.mod_time = (time_t*)calloc(file_num + 1, sizeof(time_t));
+    job.done = (char*)calloc(file_num + 1, sizeof(char));
+    parallel_for(file_num, estimate_task, &job);
+    //duplicates refer to the data of the first copy, as in compress_files()
+    HashMap *dedup_map = hashmap_create(file_num);
+    //the entries the files would take: the header size is known after the directory is coded
+    //(the entries are coded, so they get the values compress_files() would give them)
+    Header header = {0};
+    header_reserve(&header, file_num + 1);
+    unsigned *data_pos = (unsigned*)calloc(file_num + 1, sizeof(int));
+    time_t now = time(NULL);
+    unsigned long long total_size = 0, total_data = 0, header_size = 0;
+    unsigned file_cnt = 0, ix = 0;
+    for (unsigned i = 0; i < file_num; ++i) {
+        if (!job.done[i]) {
+            print_error("\t<<%s>>: failed to estimate (not a regular file)!\n", file_names[i]);
+            continue;
+        }
+        print_msg("\t<<%s>>\n", file_names[i]);
+        print_msg("\t*File size: %u bytes\n", job.size[i]);
+        if (hashmap_find(dedup_map, job.hash[i], &ix) && job.size[ix] == job.size[i] &&
+            same_files(file_names[ix], file_names[i])) {
+            //only the entry is added
+            print_msg("\t*Compressed file size: 0 bytes (duplicate of <<%s>>)\n", file_names[ix]);
+            data_pos[i] = data_pos[ix];
+        }
+        else {
+            hashmap_insert(dedup_map, job.hash[i], i);
+            data_pos[i] = total_data;
+            total_data += job.comp_size[i];
+            print_msg("\t*Compressed file size: %u bytes\n", job.comp_size[i]);
+            print_msg("\t*Compression: %d%%\n", (job.comp_size[i] >= job.size[i]) ?
+                        0 : (int)((1.0 - (double)job.comp_size[i] / job.size[i]) * 100.0));
+        }
+        print_msg("\n");
+        //the names are shared with file_names
+        FileInfo *info = &header.file[header.file_num++];
+        memset(info, 0, sizeof(FileInfo));
+        info->name = (char*)get_member_name(file_names[i]);
+        info->size = job.size[i];
+        info->comp_size = job.comp_size[i];
+        info->add_time = now;
+        info->mod_time = job.mod_time[i];
+        info->data_pos = data_pos[i];
+        info->hash = job.hash[i];
+        info->crc = job.crc[i];
+        info->method = job.method[i];
+        info->level = get_level();
+        total_size += job.size[i];
+        ++file_cnt;
+    }
+    header_size = get_header_size(&header);
+    unsigned long long arch_size = header_size + total_data;
+    print_msg("\t>>Size of files: %llu bytes\n", total_size);
+    print_msg("\t>>Size of compressed data: %llu bytes\n", total_data);
+    print_msg("\t>>Size of archive header: %llu bytes\n", header_size);
+    print_msg("\t>>Size of archive: %llu bytes\n", arch_size);
+    print_msg("\t>>Compression: %d%%\n\n", (arch_size >= total_size) ?
+                0 : (int)((1.0 - (double)arch_size / total_size) * 100.0));
+    hashmap_destroy(dedup_map);
+    free(header.file);
+    free(data_pos);
+    free(job.size);
+    free(job.comp_size);
+    free(job.hash);
+    free(job.crc);
+    free(job.method);
+    free(job.mod_time);
+    free(job.done);
+    return file_cnt;
+}
+
+void estimate_menu(char **file_names, unsigned file_num, const ArchiverOptions *options) {
+    start_menu(options, stdout);
+    //directories are estimated with all the files below them
+    unsigned path_num = 0;
+    char **paths = expand_paths(file_names, file_num, &path_num);
+    print_msg("\tFiles estimated: %u\n", estimate_files(paths, path_num));
+    free_paths(paths, path_num);
+    finish_menu();
+}
+
+//archiver menu
+
+FILE *open_archive(char *arch_name, int read_only) {
+    //returns NULL if the archive can't be created or opened (the error is printed)
+    if (access(arch_name, R_OK) != 0) {
+        //an archive does not exist
+        print_msg("\tThe file <<%s>> does not exist. Creating...\n", arch_name);
+        if (create_archive(arch_name)) {
+            print_error("\tFailed to create an archive!\n");
+            return NULL;
+        }
+    }
+    print_msg("\tOpening <<%s>>...\n", arch_name);
+    FILE *arch = fopen(arch_name, read_only ? "rb" : "rb+");
+    if (arch == NULL) {
+        print_error("\tFailed to open <<%s>>!\n", arch_name);
+    }
+    return arch;
+}
+
+void choice_menu(char *arch_name, char **file_names, unsigned file_num, MenuOption opt,
+                 const ArchiverOptions *options) {
+    int cat_to_stdout = (opt == CatMembers && (options->cat_fd == 0 || options->cat_fd == STDOUT_FILENO));
+    start_menu(options, cat_to_stdout ? stderr : stdout);
+    int read_only = is_read_only(opt);
+    FILE *arch = open_archive(arch_name, read_only);
+    if (arch == NULL) {
+        finish_menu();
+        return;
+    }
+    if (read_only) {
+        view_menu(arch, arch_name, file_names, file_num, opt);
+        goto close_files;
+    }
+    if (!check_magic_num(arch)) {
+        print_error("\tThe file <<%s>> is not an archive!\n", arch_name);
+        goto close_files;
+    }
+    uint32_t version = read_format_version(arch);
+    if (version != FORMAT_VERSION) {
+        print_error("\tThe archive <<%s>> has an unsupported format version (%u)!\n", arch_name, version);
+        goto close_files;
+    }
+    //only the header is checked here: reading a part of an archive doesn't read the whole archive
+    if (!check_header_checksum(arch)) {
+        print_error("\tThe archive <<%s>> is corrupted!\n", arch_name);
+        goto close_files;
+    }
+    rewind(arch);
+    //directories are added with all the files below them
+    char **paths = NULL;
+    unsigned path_num = 0;
+    if (opt == AddToArchive || opt == UpdateArchive || opt == UpdateByContents) {
+        paths = expand_paths(file_names, file_num, &path_num);
+    }
+    switch (opt) {
+        case AddToArchive:
+            print_msg("\tFiles added: %u\n",
+                      append_to_archive(arch, paths, path_num));
+            break;
+        case RemoveFromArchive:
+            print_msg("\tFiles removed: %u\n",
+                      remove_from_archive(arch, file_names, file_num));
+            break;
+        case RemoveAll:
+            print_msg("\tFiles removed: %u\n",
+                      remove_all(arch));
+            break;
+        case UpdateArchive:
+        case UpdateByContents:
+            print_msg("\tFiles updated: %u\n",
+                      update_archive(arch, paths, path_num, opt == UpdateByContents));
+            break;
+        default:
+            print_error("Invalid option!\n");
+            break;
+    }
+    free_paths(paths, path_num);
+    close_files:
+    file_close(arch);
+    finish_menu();
+}
+
+//batch: the commands work on the archive in memory & the archive is rewritten once at the end
+
+typedef struct Batch {
+    //the archive as opened; its header gets the entries added by the commands
+    ArchiveView view;
+    //entries deleted or replaced by the commands
+    char *deleted;
+    unsigned capacity;
+    //data of the added files, which follows the archive's data
+    FILE *new_data;
+    //the archive's data followed by new_data
+    DataSource src;
+    int changed;
+} Batch;
+
+void batch_reserve(Batch *batch, unsigned file_num) {
+    //room for the marks of the entries & of file_num new ones
+    unsigned capacity = batch->view.header->file_num + file_num + 1;
+    if (capacity > batch->capacity) {
+        batch->deleted = (char*)realloc(batch->deleted, capacity);
+        memset(batch->deleted + batch->capacity, 0, capacity - batch->capacity);
+        batch->capacity = capacity;
+    }
+}
+
+unsigned batch_add(Batch *batch, char **file_names, unsigned file_num) {
+    batch_reserve(batch, file_num);
+    unsigned file_cnt = compress_files(&batch->src, batch->new_data, batch->view.new_beg, batch->view.header, batch->deleted,
+                                       file_names, file_num);
+    batch->changed |= (file_cnt > 0);
+    return file_cnt;
+}
+
+unsigned batch_update(Batch *batch, char **file_names, unsigned file_num, int compare_hash) {
+    batch_reserve(batch, file_num);
+    char **changed_files = (char**)calloc(file_num + 1, sizeof(char*));
+    int dir_changed = 0;
+    unsigned changed_num = find_changed_files(&batch->src, batch->view.header, batch->deleted, file_names, file_num,
+                                              compare_hash, changed_files, &dir_changed);
+    unsigned file_cnt = compress_files(&batch->src, batch->new_data, batch->view.new_beg, batch->view.header, batch->deleted,
+                                       changed_files, changed_num);
+    batch->changed |= (changed_num > 0 || dir_changed);
+    free(changed_files);
+    return file_cnt;
+}
+
+unsigned batch_remove(Batch *batch, char **file_names, unsigned file_num) {
+    //file_names is NULL to remove all
+    Header *header = batch->view.header;
+    unsigned file_cnt = 0;
+    char *files_to_delete = NULL;
+    if (file_names != NULL) {
+        files_to_delete = (char*)calloc(header->file_num + 1, sizeof(char));
+        memcpy(files_to_delete, batch->deleted, header->file_num);
+        mark_files(header, files_to_delete, file_names, file_num);
+    }
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (!batch->deleted[i] && (file_names == NULL || files_to_delete[i])) {
+            batch->deleted[i] = 1;
+            ++file_cnt;
+            print_msg("\t<<%s>>: deleted!\n", header->file[i].name);
+        }
+    }
+    free(files_to_delete);
+    batch->changed |= (file_cnt > 0);
+    return file_cnt;
+}
+
+void batch_view(Batch *batch, char *arch_name, char **file_names, unsigned file_num, MenuOption opt) {
+    //the entries left by the commands before (their names are shared with the batch's header)
+    Header *header = batch->view.header;
+    Header *live = (Header*)calloc(1, sizeof(Header));
+    *live = *header;
+    live->file = NULL;
+    live->file_num = live->capacity = 0;
+    header_reserve(live, header->file_num + 1);
+    for (unsigned i = 0; i < header->file_num; ++i) {
+        if (!batch->deleted[i]) {
+            live->file[live->file_num++] = header->file[i];
+        }
+    }
+    //the added data is mapped as it is now
+    file_unmap(&batch->view.new_map);
+    if (ftell(batch->new_data) > 0) {
+        file_map(batch->new_data, &batch->view.new_map);
+    }
+    ArchiveView view = batch->view;
+    view.header = live;
+    run_view_option(&view, arch_name, file_names, file_num, opt);
+    free(live->file);
+    free(live);
+}
+
+void batch_menu(char *arch_name, BatchCommand *commands, unsigned command_num, const ArchiverOptions *options) {
+    int cat_to_stdout = 0;
+    for (unsigned i = 0; i < command_num; ++i) {
+        cat_to_stdout |= (commands[i].opt == CatMembers && (options->cat_fd == 0 || options->cat_fd == STDOUT_FILENO));
+    }
+    start_menu(options, cat_to_stdout ? stderr : stdout);
+    FILE *arch = open_archive(arch_name, 0);
+    if (arch == NULL) {
+        finish_menu();
+        return;
+    }
+    Batch batch = {0};
+    if (!open_view(arch, arch_name, &batch.view) || !load_view(&batch.view, arch_name, NULL, 0)) {
+        goto close_files;
+    }
+    batch.new_data = tmpfile();
+    if (batch.new_data == NULL) {
+        print_error("\tFailed to run the batch!\n");
+        goto close_files;
+    }
+    file_set_pos(arch, batch.view.data_beg);
+    init_data_source(&batch.src, arch, batch.new_data);
+    batch_reserve(&batch, 0);
+    for (unsigned i = 0; i < command_num && !progress_cancelled(); ++i) {
+        BatchCommand *command = &commands[i];
+        //directories are added with all the files below them
+        char **paths = NULL;
+        unsigned path_num = 0;
+        if (command->opt == AddToArchive || command->opt == UpdateArchive || command->opt == UpdateByContents) {
+            paths = expand_paths(command->file_names, command->file_num, &path_num);
+        }
+        print_msg("\n\t>>Command %u of %u:\n", i + 1, command_num);
+        switch (command->opt) {
+            case AddToArchive:
+                print_msg("\tFiles added: %u\n",
+                          batch_add(&batch, paths, path_num));
+                break;
+            case UpdateArchive:
+            case UpdateByContents:
+                print_msg("\tFiles updated: %u\n",
+                          batch_update(&batch, paths, path_num, command->opt == UpdateByContents));
+                break;
+            case RemoveFromArchive:
+                print_msg("\tFiles removed: %u\n",
+                          batch_remove(&batch, command->file_names, command->file_num));
+                break;
+            case RemoveAll:
+                print_msg("\tFiles removed: %u\n",
+                          batch_remove(&batch, NULL, 0));
+                break;
+            default:
+                batch_view(&batch, arch_name, command->file_names, command->file_num, command->opt);
+                break;
+        }
+        free_paths(paths, path_num);
+    }
+    if (progress_cancelled()) {
+        //the commands are applied all or none: the archive is left as it is
+        print_error("\tThe batch was cancelled, <<%s>> is not changed!\n", arch_name);
+    }
+    else if (batch.changed) {
+        //write the changes of all the commands & replace the archive once
+        FILE *temp_file = tmpfile();
+        if (temp_file == NULL) {
+            print_error("\tFailed to write the archive!\n");
+        }
+        else {
+            unsigned file_cnt = write_archive(temp_file, batch.view.header, batch.deleted, &batch.src);
+            //the archive isn't read through the maps any more
+            file_unmap(&batch.view.map);
+            file_unmap(&batch.view.new_map);
+            replace_archive(arch, temp_file);
+            file_close(temp_file);
+            print_msg("\n\tThe archive <<%s>> is written: %u files\n", arch_name, file_cnt);
+        }
+    }
+    else {
+        print_msg("\n\tThe archive <<%s>> is not changed\n", arch_name);
+    }
+    close_files:
+    file_close(batch.new_data);
+    free(batch.deleted);
+    close_view(&batch.view);
+    file_close(arch);
+    finish_menu();
+}
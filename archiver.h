@@ -1,17 +1,73 @@
-#ifndef ARCHIVER_H
-#define ARCHIVER_H
-
-typedef enum MenuOption {
-    AddToArchive,
-    ExtractFromArchive,
-    ExtractAll,
-    RemoveFromArchive,
-    RemoveAll,
-    CheckIntegrity,
-    PrintInfo,
-    InvalidOption
-} MenuOption;
-
-void choice_menu(char *arch_name, char **file_names, unsigned file_num, MenuOption opt);
-
-#endif // ARCHIVER_H
+#ifndef ARCHIVER_H
+#define ARCHIVER_H
+
+#include "progress.h"
+
+typedef enum MenuOption {
+    AddToArchive,
+    UpdateArchive,
+    UpdateByContents,
+    ExtractFromArchive,
+    ExtractAll,
+    RemoveFromArchive,
+    RemoveAll,
+    CheckIntegrity,
+    PrintInfo,
+    CatMembers,
+    InvalidOption
+} MenuOption;
+
+typedef enum StatsFormat {
+    NoStats,
+    StatsTable,
+    StatsJson
+} StatsFormat;
+
+typedef struct ArchiverOptions {
+    //code every added file in one pass
+    int adaptive;
+    //compression level 1-9 (0 is the default, 6)
+    int level;
+    //print the time of every phase & member at exit
+    StatsFormat stats;
+    //write begin/end events of the operation to this file (Chrome trace JSON)
+    const char *trace_file;
+    //invoked as the coding goes on; a nonzero return cancels the operation, keeping the archive consistent
+    ProgressCallback progress;
+    void *progress_arg;
+    //the descriptor CatMembers decodes to (stdout if 0)
+    int cat_fd;
+    //extract small members in io_uring batches (Linux) rather than one by one
+    int uring;
+} ArchiverOptions;
+
+//messages of the operations (stdout, or stderr while members are decoded to stdout) & errors (stderr)
+
+void print_msg(const char *msg, ...);
+
+void print_error(const char *msg, ...);
+
+void choice_menu(char *arch_name, char **file_names, unsigned file_num, MenuOption opt,
+                 const ArchiverOptions *options);
+
+//the number of members the last extraction wrote through io_uring batches (0 if they were written one by one)
+
+unsigned get_batched_member_num(void);
+
+//print the size of the files coded statically & of their archive without coding them
+
+void estimate_menu(char **file_names, unsigned file_num, const ArchiverOptions *options);
+
+//run the commands one after another on the archive opened once: the reading commands see the changes
+//of the commands before, and the changes are written at the end in one rewrite of the archive
+//(none of them if the batch is cancelled)
+
+typedef struct BatchCommand {
+    MenuOption opt;
+    char **file_names;
+    unsigned file_num;
+} BatchCommand;
+
+void batch_menu(char *arch_name, BatchCommand *commands, unsigned command_num, const ArchiverOptions *options);
+
+#endif // ARCHIVER_H
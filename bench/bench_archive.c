@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+//end-to-end benchmark: runs the archiver on the corpus made by gen_corpus
+//results are written as JSON lines (one per dataset & operation) to the results file or stdout,
+//a table is printed to stderr
+
+#define MAX_ARGS 4096
+#define SMALL_FILE_NUM 2000
+
+static const char *datasets[] = {"text.txt", "binary.bin", "random.bin", "skewed.bin"};
+
+static char archiver[PATH_MAX];
+static char corpus_dir[PATH_MAX];
+static char work_dir[PATH_MAX];
+static unsigned repeat_num = 3;
+static FILE *results = NULL;
+
+typedef struct Result {
+    double seconds;
+    long peak_rss_kb;
+    int failed;
+} Result;
+
+//helpers
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void make_path(char *path, const char *format, ...) {
+    //path has PATH_MAX chars; a path that doesn't fit ends the benchmark rather than running on a cut one
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(path, PATH_MAX, format, args);
+    va_end(args);
+    if (len < 0 || len >= PATH_MAX) {
+        fprintf(stderr, "bench_archive: the path is too long!\n");
+        exit(1);
+    }
+}
+
+static unsigned long long path_size(const char *dir, const char *name) {
+    char path[PATH_MAX];
+    struct stat file_stat;
+    make_path(path, "%s/%s", dir, name);
+    return (stat(path, &file_stat) == 0) ? (unsigned long long)file_stat.st_size : 0;
+}
+
+static Result run_once(const char *cwd, char **args) {
+    //run the archiver in cwd; its output is dropped
+    Result result = {0};
+    double beg = now_seconds();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (chdir(cwd) != 0) {
+            _exit(127);
+        }
+        execv(archiver, args);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+        result.failed = 1;
+        return result;
+    }
+    result.seconds = now_seconds() - beg;
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    return result;
+}
+
+static Result run(const char *cwd, char **args, void (*prepare)(void)) {
+    //the best time & the largest peak memory of repeat_num runs
+    Result best = {0};
+    for (unsigned i = 0; i < repeat_num; ++i) {
+        if (prepare != NULL) {
+            prepare();
+        }
+        Result result = run_once(cwd, args);
+        if (i == 0 || result.seconds < best.seconds) {
+            best.seconds = result.seconds;
+        }
+        if (result.peak_rss_kb > best.peak_rss_kb) {
+            best.peak_rss_kb = result.peak_rss_kb;
+        }
+        best.failed |= result.failed;
+    }
+    return best;
+}
+
+static void report(const char *dataset, const char *op, unsigned long long bytes,
+                   unsigned long long comp_bytes, Result result) {
+    double mb_s = (result.seconds > 0) ? bytes / 1048576.0 / result.seconds : 0;
+    double ratio = (bytes > 0) ? (double)comp_bytes / bytes : 0;
+    fprintf(results, "{\"dataset\":\"%s\",\"op\":\"%s\",\"bytes\":%llu,\"comp_bytes\":%llu,\"seconds\":%.6f,"
+           "\"mb_s\":%.3f,\"ratio\":%.4f,\"peak_rss_kb\":%ld,\"ok\":%s}\n",
+           dataset, op, bytes, comp_bytes, result.seconds, mb_s, ratio, result.peak_rss_kb,
+           result.failed ? "false" : "true");
+    fflush(results);
+    fprintf(stderr, "%-12s %-9s %10.2f MB/s %8.4f ratio %9ld KB%s\n",
+            dataset, op, mb_s, ratio, result.peak_rss_kb, result.failed ? "  FAILED" : "");
+}
+
+//archive preparation between repetitions
+
+static char arch_path[PATH_MAX];
+static char **compress_args = NULL;
+
+static void remove_archive(void) {
+    unlink(arch_path);
+}
+
+static void recreate_archive(void) {
+    //the archive before each delete run
+    unlink(arch_path);
+    run_once(corpus_dir, compress_args);
+}
+
+//benchmarks
+
+static void bench_files(const char *dataset, char **names, unsigned name_num, unsigned long long bytes) {
+    static char *args[MAX_ARGS + 4];
+    char out_dir[PATH_MAX];
+    make_path(arch_path, "%s/%s.arc", work_dir, dataset);
+    make_path(out_dir, "%s/out", work_dir);
+    mkdir(out_dir, 0755);
+    make_path(out_dir, "%s/out/small", work_dir);
+    mkdir(out_dir, 0755);
+    make_path(out_dir, "%s/out", work_dir);
+
+    //compress
+    args[0] = archiver;
+    args[1] = "-a";
+    args[2] = arch_path;
+    for (unsigned i = 0; i < name_num; ++i) {
+        args[3 + i] = names[i];
+    }
+    args[3 + name_num] = NULL;
+    Result result = run(corpus_dir, args, remove_archive);
+    unsigned long long comp_bytes = path_size(work_dir, strrchr(arch_path, '/') + 1);
+    report(dataset, "compress", bytes, comp_bytes, result);
+    //list, test & extract the archive
+    char *list_args[] = {archiver, "-l", arch_path, NULL};
+    report(dataset, "list", comp_bytes, comp_bytes, run(corpus_dir, list_args, NULL));
+    char *test_args[] = {archiver, "-t", arch_path, NULL};
+    report(dataset, "test", bytes, comp_bytes, run(corpus_dir, test_args, NULL));
+    char *extract_args[] = {archiver, "-xall", arch_path, NULL};
+    report(dataset, "extract", bytes, comp_bytes, run(out_dir, extract_args, NULL));
+}
+
+static void bench_add_delete(void) {
+    //add the skewed data to the text archive & delete it again
+    make_path(arch_path, "%s/add.arc", work_dir);
+    static char *base_args[] = {NULL, "-a", arch_path, "text.txt", NULL};
+    base_args[0] = archiver;
+    char *add_args[] = {archiver, "-a", arch_path, "skewed.bin", NULL};
+    char *delete_args[] = {archiver, "-d", arch_path, "skewed.bin", NULL};
+    unsigned long long bytes = path_size(corpus_dir, "skewed.bin");
+
+    compress_args = base_args;
+    Result result = run(corpus_dir, add_args, recreate_archive);
+    unsigned long long comp_bytes = path_size(work_dir, "add.arc");
+    report("skewed.bin", "add", bytes, comp_bytes, result);
+    //the archive has the added file before every delete run
+    static char *full_args[] = {NULL, "-a", arch_path, "text.txt", "skewed.bin", NULL};
+    full_args[0] = archiver;
+    compress_args = full_args;
+    report("skewed.bin", "delete", comp_bytes, comp_bytes, run(corpus_dir, delete_args, recreate_archive));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s archiver corpus_dir [work_dir] [repeat_num] [results_file]\n", argv[0]);
+        return 1;
+    }
+    if (realpath(argv[1], archiver) == NULL || realpath(argv[2], corpus_dir) == NULL) {
+        fprintf(stderr, "bench_archive: the archiver or the corpus was not found!\n");
+        return 1;
+    }
+    const char *work_name = (argc > 3) ? argv[3] : "bench_work";
+    mkdir(work_name, 0755);
+    if (realpath(work_name, work_dir) == NULL) {
+        fprintf(stderr, "bench_archive: failed to create the work directory!\n");
+        return 1;
+    }
+    if (argc > 4) {
+        repeat_num = atoi(argv[4]);
+    }
+    results = (argc > 5) ? fopen(argv[5], "w") : stdout;
+    if (results == NULL) {
+        fprintf(stderr, "bench_archive: failed to create the results file!\n");
+        return 1;
+    }
+    //single large files
+    for (unsigned i = 0; i < sizeof(datasets) / sizeof(datasets[0]); ++i) {
+        char *name = (char*)datasets[i];
+        bench_files(datasets[i], &name, 1, path_size(corpus_dir, datasets[i]));
+    }
+    //many small files
+    static char names[SMALL_FILE_NUM][32];
+    static char *name_ptrs[SMALL_FILE_NUM];
+    unsigned long long bytes = 0;
+    for (unsigned i = 0; i < SMALL_FILE_NUM; ++i) {
+        snprintf(names[i], sizeof(names[i]), "small/%04u.txt", i);
+        name_ptrs[i] = names[i];
+        bytes += path_size(corpus_dir, names[i]);
+    }
+    bench_files("small", name_ptrs, SMALL_FILE_NUM, bytes);
+    //updating an archive
+    bench_add_delete();
+    if (results != stdout) {
+        fclose(results);
+    }
+    return 0;
+}
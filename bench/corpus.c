@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "corpus.h"
+
+static uint64_t rng_state = 0;
+
+static uint32_t rng_next(void) {
+    //xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static const char *names[DatasetNum] = {"text", "binary", "random", "skewed", "sparse", "single"};
+
+const char *dataset_name(Dataset dataset) {
+    return names[dataset];
+}
+
+//datasets
+
+static void gen_text(unsigned char *data, unsigned size) {
+    static const char *words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with",
+        "be", "by", "on", "not", "he", "this", "are", "or", "his", "from", "at", "which",
+        "archive", "huffman", "compression", "buffer", "symbol", "frequency", "tree",
+        "encoder", "decoder", "checksum", "directory", "benchmark", "throughput", "latency"
+    };
+    const unsigned word_num = sizeof(words) / sizeof(words[0]);
+    unsigned pos = 0, line_len = 0;
+    while (pos < size) {
+        //small indices are much more frequent
+        unsigned ix = (rng_next() % word_num) * (rng_next() % word_num) / word_num;
+        const char *sep = (line_len > 72) ? ".\n" : ((rng_next() % 16 == 0) ? ", " : " ");
+        line_len = (line_len > 72) ? 0 : line_len + strlen(words[ix]) + 1;
+        for (const char *p = words[ix]; *p && pos < size; ++p) {
+            data[pos++] = *p;
+        }
+        for (const char *p = sep; *p && pos < size; ++p) {
+            data[pos++] = *p;
+        }
+    }
+}
+
+static void gen_binary(unsigned char *data, unsigned size) {
+    for (unsigned i = 0; i < size; i += 16) {
+        uint32_t rec[4] = {i / 16, rng_next() % 1000, rng_next() & 0x0F0F, 0};
+        memcpy(data + i, rec, (size - i < sizeof(rec)) ? size - i : sizeof(rec));
+    }
+}
+
+static void gen_random(unsigned char *data, unsigned size) {
+    for (unsigned i = 0; i < size; ++i) {
+        data[i] = rng_next();
+    }
+}
+
+static void gen_skewed(unsigned char *data, unsigned size) {
+    for (unsigned i = 0; i < size; ++i) {
+        unsigned char sym = 0;
+        while (sym < 255 && (rng_next() & 7) == 0) {
+            ++sym;
+        }
+        data[i] = sym;
+    }
+}
+
+static void gen_sparse(unsigned char *data, unsigned size) {
+    //runs of 4..68 KB of zeros between 1..9 KB of text
+    memset(data, 0, size);
+    for (unsigned pos = 0; pos < size; ) {
+        unsigned len = 1024 + rng_next() % (8 * 1024);
+        len = (len < size - pos) ? len : size - pos;
+        gen_text(data + pos, len);
+        pos += len;
+        pos += (size - pos < 4096) ? size - pos : 4096 + rng_next() % (64 * 1024);
+    }
+}
+
+unsigned char *make_dataset(Dataset dataset, unsigned size) {
+    return make_dataset_seeded(dataset, size, 0);
+}
+
+unsigned char *make_dataset_seeded(Dataset dataset, unsigned size, unsigned seed) {
+    unsigned char *data = (unsigned char*)malloc(size + 1);
+    rng_state = 0x9E3779B97F4A7C15ULL + dataset + ((uint64_t)seed << 32);
+    switch (dataset) {
+        case TextData:
+            gen_text(data, size);
+            break;
+        case BinaryData:
+            gen_binary(data, size);
+            break;
+        case RandomData:
+            gen_random(data, size);
+            break;
+        case SkewedData:
+            gen_skewed(data, size);
+            break;
+        case SparseData:
+            gen_sparse(data, size);
+            break;
+        default:
+            memset(data, 'a', size);
+            break;
+    }
+    return data;
+}
+
+FILE *make_temp_file(const unsigned char *data, unsigned size) {
+    FILE *file = tmpfile();
+    if (file != NULL) {
+        fwrite(data, sizeof(char), size, file);
+        rewind(file);
+    }
+    return file;
+}
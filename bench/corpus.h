@@ -0,0 +1,37 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdio.h>
+
+//reproducible data of the benchmarks & of the tests: the same dataset, size & seed give the same bytes
+//on every machine
+
+typedef enum Dataset {
+    //words of a Zipf-like vocabulary with punctuation & line breaks
+    TextData,
+    //records of small integers & flags
+    BinaryData,
+    //uniformly random bytes (incompressible)
+    RandomData,
+    //geometric distribution: most bytes are zero
+    SkewedData,
+    //text between long runs of zeros
+    SparseData,
+    //one symbol repeated
+    SingleData,
+    DatasetNum
+} Dataset;
+
+const char *dataset_name(Dataset dataset);
+
+//the data of the size (malloc'd); make_dataset() is seed 0
+
+unsigned char *make_dataset(Dataset dataset, unsigned size);
+
+unsigned char *make_dataset_seeded(Dataset dataset, unsigned size, unsigned seed);
+
+//a temporary file with the data, rewound
+
+FILE *make_temp_file(const unsigned char *data, unsigned size);
+
+#endif // CORPUS_H
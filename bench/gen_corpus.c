@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "corpus.h"
+
+//reproducible benchmark corpus: the same seed gives the same files on every machine
+//(the datasets are those of the tests, see corpus.h)
+
+#define SMALL_FILE_NUM 2000
+
+static FILE *open_output(const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "gen_corpus: failed to create <<%s>>!\n", path);
+        exit(1);
+    }
+    return file;
+}
+
+static void write_dataset(const char *dir, const char *name, Dataset dataset, unsigned size, unsigned seed) {
+    unsigned char *data = make_dataset_seeded(dataset, size, seed);
+    FILE *file = open_output(dir, name);
+    fwrite(data, sizeof(char), size, file);
+    fclose(file);
+    free(data);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s corpus_dir [size_in_MB]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    unsigned size = ((argc > 2) ? (unsigned)atoi(argv[2]) : 8) << 20;
+    mkdir(dir, 0755);
+
+    write_dataset(dir, "text.txt", TextData, size, 0);
+    write_dataset(dir, "binary.bin", BinaryData, size, 0);
+    write_dataset(dir, "random.bin", RandomData, size, 0);
+    write_dataset(dir, "skewed.bin", SkewedData, size, 0);
+
+    //many small text files of 1..8 KB
+    char name[64];
+    snprintf(name, sizeof(name), "%s/small", dir);
+    mkdir(name, 0755);
+    for (unsigned i = 0; i < SMALL_FILE_NUM; ++i) {
+        //every file has a seed of its own, so the files aren't copies of each other
+        snprintf(name, sizeof(name), "small/%04u.txt", i);
+        write_dataset(dir, name, TextData, 1024 + (i * 2654435761u) % (7 * 1024), i + 1);
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "file_processing.h"
+#include "binary_buffer.h"
+#include "huffman_tree.h"
+#include "huffman_coding.h"
+#include "corpus.h"
+
+//micro-benchmarks of the codec primitives over fixed inputs
+//every case is run WARMUP_NUM times, then timed REPEAT_NUM times; the best & the median are reported
+//alternative implementations of a primitive are registered under the same primitive name
+
+#define WARMUP_NUM 2
+#define REPEAT_NUM 15
+//below the pipelining threshold, so only the coding thread is measured
+#define INPUT_SIZE (512u << 10)
+#define CRC_INPUT_SIZE (8u << 20)
+
+//inputs
+
+static unsigned char *crc_input = NULL;
+static FILE *text_file = NULL;
+static FILE *encoded_file = NULL;
+static unsigned encoded_size = 0;
+static Tree code_tree;
+static unsigned char *text_input = NULL;
+
+static void make_inputs(void) {
+    //the datasets of the benchmarks & tests (bench/corpus.c)
+    crc_input = make_dataset(RandomData, CRC_INPUT_SIZE);
+    //text: many distinct code lengths
+    text_input = make_dataset(TextData, INPUT_SIZE);
+    text_file = make_temp_file(text_input, INPUT_SIZE);
+    //the code tree & table of the text
+    analyze_file(text_file);
+    build_code_tree(&code_tree);
+    build_code_table(&code_tree);
+    //the encoded text
+    encoded_file = tmpfile();
+    encode_file(text_file, encoded_file);
+    encoded_size = ftell(encoded_file);
+    rewind(text_file);
+}
+
+//cases
+
+static volatile uint32_t sink = 0;
+
+static uint32_t crc32_bitwise(const unsigned char *data, size_t n_bytes, uint32_t crc) {
+    //the same checksum without the table
+    for (size_t i = 0; i < n_bytes; ++i) {
+        crc = crc32_for_byte((uint8_t)crc ^ data[i]) ^ crc >> 8;
+    }
+    return crc;
+}
+
+static void run_crc32_table(void) {
+    uint32_t crc = 0;
+    crc32(crc_input, CRC_INPUT_SIZE, &crc);
+    sink = crc;
+}
+
+static void run_crc32_bitwise(void) {
+    sink = crc32_bitwise(crc_input, CRC_INPUT_SIZE, 0);
+}
+
+static void run_analyze_file(void) {
+    rewind(text_file);
+    analyze_file(text_file);
+}
+
+static void run_build_code_tree(void) {
+    //the frequencies of the text are left by analyze_file()
+    Tree tree;
+    build_code_tree(&tree);
+    sink = tree.node[tree.root].label.freq;
+}
+
+static void run_build_code_table(void) {
+    build_code_table(&code_tree);
+}
+
+static void run_write_code_to_outbuf(void) {
+    //codes of the text are written to a null sink
+    build_code_table(&code_tree);
+    outbuf_reset();
+    for (unsigned i = 0; i < INPUT_SIZE; ++i) {
+        write_code_to_outbuf(NULL, get_code(text_input[i]));
+    }
+    write_to_file(NULL);
+}
+
+static void run_decode(void) {
+    //the tree & the symbols of the encoded text are decoded to a null sink
+    rewind(encoded_file);
+    sink = decode_file(encoded_file, NULL, INPUT_SIZE, encoded_size);
+}
+
+typedef struct MicroBench {
+    const char *primitive;
+    const char *impl;
+    void (*run)(void);
+    unsigned bytes;
+} MicroBench;
+
+static const MicroBench benches[] = {
+    {"crc32", "table", run_crc32_table, CRC_INPUT_SIZE},
+    {"crc32", "bitwise", run_crc32_bitwise, CRC_INPUT_SIZE},
+    {"analyze_file", "histogram", run_analyze_file, INPUT_SIZE},
+    {"build_code_tree", "two_queue", run_build_code_tree, 0},
+    {"build_code_table", "traversal", run_build_code_table, 0},
+    {"write_code_to_outbuf", "string", run_write_code_to_outbuf, INPUT_SIZE},
+    {"decode", "tree_walk", run_decode, INPUT_SIZE},
+};
+
+//timing
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+    //an optional argument selects the primitive to run
+    const char *filter = (argc > 1) ? argv[1] : NULL;
+    make_inputs();
+    fprintf(stderr, "%-22s %-10s %14s %14s %10s\n", "primitive", "impl", "best, ns", "median, ns", "MB/s");
+    for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        const MicroBench *bench = &benches[i];
+        if (filter != NULL && strcmp(filter, bench->primitive)) {
+            continue;
+        }
+        double times[REPEAT_NUM];
+        for (unsigned j = 0; j < WARMUP_NUM; ++j) {
+            bench->run();
+        }
+        for (unsigned j = 0; j < REPEAT_NUM; ++j) {
+            double beg = now_ns();
+            bench->run();
+            times[j] = now_ns() - beg;
+        }
+        qsort(times, REPEAT_NUM, sizeof(double), cmp_double);
+        double mb_s = bench->bytes ? bench->bytes / 1048576.0 / (times[0] * 1e-9) : 0;
+        fprintf(stderr, "%-22s %-10s %14.0f %14.0f %10.2f\n",
+                bench->primitive, bench->impl, times[0], times[REPEAT_NUM / 2], mb_s);
+        printf("{\"primitive\":\"%s\",\"impl\":\"%s\",\"best_ns\":%.0f,\"median_ns\":%.0f,\"mb_s\":%.3f}\n",
+               bench->primitive, bench->impl, times[0], times[REPEAT_NUM / 2], mb_s);
+    }
+    file_close(text_file);
+    file_close(encoded_file);
+    free(crc_input);
+    free(text_input);
+    return 0;
+}
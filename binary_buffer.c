@@ -1,98 +1,243 @@
-#include <string.h>
-#include "binary_buffer.h"
-
-#define BUF_SIZE 1024
-
-unsigned char inbuf[BUF_SIZE] = {0};
-unsigned char outbuf[BUF_SIZE] = {0};
-
-int INBUF_BYTE_POS = 0;
-int OUTBUF_BYTE_POS = 0;
-unsigned char INBUF_BIT_MASK = 1u;
-unsigned char OUTBUF_BIT_MASK = 1u;
-
-//read from/write to file
-
-unsigned read_from_file(FILE *fInput) {
-    inbuf_reset();
-    return fread(inbuf, sizeof(char), BUF_SIZE, fInput);
-}
-
-unsigned write_to_file(FILE *fOutput) {
-    int byte_num = OUTBUF_BYTE_POS + ((OUTBUF_BIT_MASK == 1u) ? 0 : 1);
-    unsigned bytes_written = fwrite(outbuf, sizeof(char), byte_num, fOutput);
-    outbuf_reset();
-    return bytes_written;
-}
-
-//reset buffers
-
-void outbuf_reset(void) {
-    OUTBUF_BYTE_POS = 0;
-    OUTBUF_BIT_MASK = 1u;
-    memset(outbuf, 0, BUF_SIZE);
-}
-
-void inbuf_reset(void) {
-    INBUF_BYTE_POS = 0;
-    INBUF_BIT_MASK = 1u;
-    memset(inbuf, 0, BUF_SIZE);
-}
-
-//check for buffer's end
-
-inline int end_of_inbuf(void) {
-    return INBUF_BYTE_POS == BUF_SIZE;
-}
-
-inline int end_of_outbuf(void) {
-    return OUTBUF_BYTE_POS == BUF_SIZE;
-}
-
-//move to the next byte
-
-int inbuf_next_byte(void) {
-    //move to the next byte and update byte/bit index of the buffer
-    ++INBUF_BYTE_POS;
-    INBUF_BIT_MASK = 1u;
-    return end_of_inbuf();
-}
-
-int outbuf_next_byte(void) {
-    //move to the next byte and update byte/bit index of the buffer
-    ++OUTBUF_BYTE_POS;
-    OUTBUF_BIT_MASK = 1u;
-    return end_of_outbuf();
-}
-
-//move to the next bit
-
-inline int inbuf_next_bit(void) {
-    return (INBUF_BIT_MASK <<= 1u) ? 0 : inbuf_next_byte();
-}
-
-inline int outbuf_next_bit(void) {
-    return (OUTBUF_BIT_MASK <<= 1u) ? 0 : outbuf_next_byte();
-}
-
-//set or get a bit/byte at the current position
-
-inline unsigned inbuf_get_bit(void) {
-    return inbuf[INBUF_BYTE_POS] & INBUF_BIT_MASK;
-}
-
-inline unsigned inbuf_get_byte(void) {
-    return inbuf[INBUF_BYTE_POS];
-}
-
-inline void outbuf_set_bit(void) {
-    outbuf[OUTBUF_BYTE_POS] |= OUTBUF_BIT_MASK;
-}
-
-inline void outbuf_reset_bit(void) {
-    outbuf[OUTBUF_BYTE_POS] &= ~OUTBUF_BIT_MASK;
-}
-
-inline void outbuf_set_byte(unsigned char byte) {
-    outbuf[OUTBUF_BYTE_POS] = byte;
-}
+#include <string.h>
+#include "file_processing.h"
+#include "io_pipeline.h"
+#include "progress.h"
+#include "binary_buffer.h"
+
+#define BUF_SIZE 1024
+
+//every thread has its own buffers
+
+_Thread_local unsigned char inbuf_mem[BUF_SIZE] = {0};
+_Thread_local unsigned char outbuf_mem[BUF_SIZE] = {0};
+
+//the buffers are either the arrays above (set on reset) or blocks of attached pipes
+
+_Thread_local unsigned char *inbuf = NULL;
+_Thread_local unsigned char *outbuf = NULL;
+_Thread_local int INBUF_SIZE = BUF_SIZE;
+_Thread_local int OUTBUF_SIZE = BUF_SIZE;
+
+_Thread_local Pipe *in_pipe = NULL;
+_Thread_local Pipe *out_pipe = NULL;
+
+//the input in memory: handed out in blocks, so the progress is reported as for files
+
+#define MEM_BLOCK_SIZE (1u << 18)
+
+_Thread_local const unsigned char *in_mem = NULL;
+_Thread_local unsigned in_mem_left = 0;
+
+_Thread_local int INBUF_BYTE_POS = 0;
+_Thread_local int OUTBUF_BYTE_POS = 0;
+_Thread_local unsigned char INBUF_BIT_MASK = 1u;
+_Thread_local unsigned char OUTBUF_BIT_MASK = 1u;
+
+//checksum of the data written from the output buffer
+
+_Thread_local uint32_t OUTBUF_CRC = 0;
+
+//read from/write to file
+
+unsigned read_from_file(FILE *fInput) {
+    if (in_mem != NULL) {
+        INBUF_BYTE_POS = 0;
+        INBUF_BIT_MASK = 1u;
+        if (in_mem_left == 0) {
+            //past the end the input reads as zeros, like a file read to the end
+            inbuf = inbuf_mem;
+            INBUF_SIZE = BUF_SIZE;
+            memset(inbuf, 0, BUF_SIZE);
+            return 0;
+        }
+        unsigned len = (in_mem_left < MEM_BLOCK_SIZE) ? in_mem_left : MEM_BLOCK_SIZE;
+        //the buffer is only read while memory is attached
+        inbuf = (unsigned char*)in_mem;
+        INBUF_SIZE = len;
+        in_mem += len;
+        in_mem_left -= len;
+        return progress_add(len) ? 0 : len;
+    }
+    if (in_pipe != NULL) {
+        //take the next block read by the pipe's thread
+        INBUF_BYTE_POS = 0;
+        INBUF_BIT_MASK = 1u;
+        unsigned len = pipe_read(in_pipe, &inbuf);
+        INBUF_SIZE = PIPE_BLOCK_SIZE;
+        //a cancelled coding sees the end of the input
+        return progress_add(len) ? 0 : len;
+    }
+    inbuf_reset();
+    unsigned len = fread(inbuf, sizeof(char), BUF_SIZE, fInput);
+    return progress_add(len) ? 0 : len;
+}
+
+unsigned write_to_file(FILE *fOutput) {
+    int byte_num = OUTBUF_BYTE_POS + ((OUTBUF_BIT_MASK == 1u) ? 0 : 1);
+    unsigned bytes_written = byte_num;
+    crc32(outbuf, byte_num, &OUTBUF_CRC);
+    if (out_pipe != NULL) {
+        //hand the block to the pipe's thread & take a free one
+        pipe_put_block(out_pipe, byte_num);
+        outbuf = pipe_get_block(out_pipe);
+    }
+    else if (fOutput != NULL) {
+        bytes_written = fwrite(outbuf, sizeof(char), byte_num, fOutput);
+    }
+    outbuf_reset();
+    return bytes_written;
+}
+
+void outbuf_write_zeros(FILE *fOutput, unsigned len) {
+    write_to_file(fOutput);
+    if (fOutput != NULL && out_pipe != NULL) {
+        //the file is positioned after the blocks written so far
+        pipe_drain(out_pipe);
+    }
+    if (fOutput == NULL || file_write_hole(fOutput, len)) {
+        crc32_zeros(len, &OUTBUF_CRC);
+        return;
+    }
+    //streams get the zeros (the buffer is zeroed by write_to_file())
+    while (len > 0) {
+        OUTBUF_BYTE_POS = (len < (unsigned)OUTBUF_SIZE) ? len : (unsigned)OUTBUF_SIZE;
+        len -= OUTBUF_BYTE_POS;
+        write_to_file(fOutput);
+    }
+}
+
+//attach/detach pipes
+
+void inbuf_attach(FILE *fInput, unsigned limit) {
+    if (in_mem == NULL) {
+        in_pipe = pipe_open_reader(fInput, limit);
+    }
+}
+
+void inbuf_attach_memory(const unsigned char *data, unsigned size) {
+    in_mem = data;
+    in_mem_left = size;
+}
+
+void inbuf_detach(void) {
+    in_pipe = pipe_close(in_pipe);
+    in_mem = NULL;
+    in_mem_left = 0;
+    inbuf = inbuf_mem;
+    INBUF_SIZE = BUF_SIZE;
+}
+
+void outbuf_attach(FILE *fOutput) {
+    if (fOutput != NULL && (out_pipe = pipe_open_writer(fOutput)) != NULL) {
+        outbuf = pipe_get_block(out_pipe);
+        OUTBUF_SIZE = PIPE_BLOCK_SIZE;
+        outbuf_reset();
+    }
+}
+
+void outbuf_detach(void) {
+    //the buffer is supposed to be written by write_to_file()
+    out_pipe = pipe_close(out_pipe);
+    outbuf = outbuf_mem;
+    OUTBUF_SIZE = BUF_SIZE;
+    outbuf_reset();
+}
+
+//raw buffer contents
+
+const unsigned char *inbuf_data(void) {
+    return inbuf;
+}
+
+//checksum of the written data
+
+void outbuf_crc_reset(void) {
+    OUTBUF_CRC = 0;
+}
+
+uint32_t outbuf_crc(void) {
+    return OUTBUF_CRC;
+}
+
+//reset buffers
+
+void outbuf_reset(void) {
+    if (outbuf == NULL) {
+        outbuf = outbuf_mem;
+    }
+    OUTBUF_BYTE_POS = 0;
+    OUTBUF_BIT_MASK = 1u;
+    memset(outbuf, 0, OUTBUF_SIZE);
+}
+
+void inbuf_reset(void) {
+    if (inbuf == NULL) {
+        inbuf = inbuf_mem;
+    }
+    INBUF_BYTE_POS = 0;
+    INBUF_BIT_MASK = 1u;
+    memset(inbuf, 0, INBUF_SIZE);
+}
+
+//check for buffer's end
+
+inline int end_of_inbuf(void) {
+    return INBUF_BYTE_POS == INBUF_SIZE;
+}
+
+inline int end_of_outbuf(void) {
+    return OUTBUF_BYTE_POS == OUTBUF_SIZE;
+}
+
+//move to the next byte
+
+int inbuf_next_byte(void) {
+    //move to the next byte and update byte/bit index of the buffer
+    ++INBUF_BYTE_POS;
+    INBUF_BIT_MASK = 1u;
+    return end_of_inbuf();
+}
+
+int outbuf_next_byte(void) {
+    //move to the next byte and update byte/bit index of the buffer
+    ++OUTBUF_BYTE_POS;
+    OUTBUF_BIT_MASK = 1u;
+    return end_of_outbuf();
+}
+
+void inbuf_skip_bytes(unsigned len) {
+    INBUF_BYTE_POS += len;
+    INBUF_BIT_MASK = 1u;
+}
+
+//move to the next bit
+
+inline int inbuf_next_bit(void) {
+    return (INBUF_BIT_MASK <<= 1u) ? 0 : inbuf_next_byte();
+}
+
+inline int outbuf_next_bit(void) {
+    return (OUTBUF_BIT_MASK <<= 1u) ? 0 : outbuf_next_byte();
+}
+
+//set or get a bit/byte at the current position
+
+inline unsigned inbuf_get_bit(void) {
+    return inbuf[INBUF_BYTE_POS] & INBUF_BIT_MASK;
+}
+
+inline unsigned inbuf_get_byte(void) {
+    return inbuf[INBUF_BYTE_POS];
+}
+
+inline void outbuf_set_bit(void) {
+    outbuf[OUTBUF_BYTE_POS] |= OUTBUF_BIT_MASK;
+}
+
+inline void outbuf_reset_bit(void) {
+    outbuf[OUTBUF_BYTE_POS] &= ~OUTBUF_BIT_MASK;
+}
+
+inline void outbuf_set_byte(unsigned char byte) {
+    outbuf[OUTBUF_BYTE_POS] = byte;
+}
@@ -1,40 +1,67 @@
-#ifndef BINARY_BUFFER_H
-#define BINARY_BUFFER_H
-
-#include <stdio.h>
-
-//read from/write to file
-
-unsigned read_from_file(FILE *fInput);
-unsigned write_to_file(FILE *fOutput);
-
-//reset buffers
-
-void inbuf_reset(void);
-void outbuf_reset(void);
-
-//check for buffer's end
-
-int end_of_inbuf(void);
-int end_of_outbuf(void);
-
-//move to the next byte
-
-int inbuf_next_byte(void);
-int outbuf_next_byte(void);
-
-//move to the next bit
-
-int inbuf_next_bit(void);
-int outbuf_next_bit(void);
-
-//set or get a bit/byte at the current position
-
-unsigned inbuf_get_bit(void);
-unsigned inbuf_get_byte(void);
-
-void outbuf_set_bit(void);
-void outbuf_reset_bit(void);
-void outbuf_set_byte(unsigned char byte);
-
-#endif // BINARY_BUFFER_H
+#ifndef BINARY_BUFFER_H
+#define BINARY_BUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//read from/write to file
+
+unsigned read_from_file(FILE *fInput);
+unsigned write_to_file(FILE *fOutput);
+
+//write len zeros from a byte boundary: a hole if the output is a regular file
+
+void outbuf_write_zeros(FILE *fOutput, unsigned len);
+
+//attach/detach pipes: reading & writing are done by separate threads
+
+void inbuf_attach(FILE *fInput, unsigned limit);
+void inbuf_detach(void);
+
+void outbuf_attach(FILE *fOutput);
+void outbuf_detach(void);
+
+//read from memory instead of a file (detached by inbuf_detach()): the data isn't copied
+
+void inbuf_attach_memory(const unsigned char *data, unsigned size);
+
+//checksum of the data written by write_to_file() (a NULL file is a null sink)
+
+void outbuf_crc_reset(void);
+uint32_t outbuf_crc(void);
+
+//raw buffer contents
+
+const unsigned char *inbuf_data(void);
+
+//reset buffers
+
+void inbuf_reset(void);
+void outbuf_reset(void);
+
+//check for buffer's end
+
+int end_of_inbuf(void);
+int end_of_outbuf(void);
+
+//move to the next byte
+
+int inbuf_next_byte(void);
+void inbuf_skip_bytes(unsigned len);
+int outbuf_next_byte(void);
+
+//move to the next bit
+
+int inbuf_next_bit(void);
+int outbuf_next_bit(void);
+
+//set or get a bit/byte at the current position
+
+unsigned inbuf_get_bit(void);
+unsigned inbuf_get_byte(void);
+
+void outbuf_set_bit(void);
+void outbuf_reset_bit(void);
+void outbuf_set_byte(unsigned char byte);
+
+#endif // BINARY_BUFFER_H
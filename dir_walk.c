@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "archiver.h"
+#include "file_processing.h"
+#include "thread_pool.h"
+#include "dir_walk.h"
+
+typedef struct PathList {
+    char **paths;
+    unsigned num;
+    unsigned capacity;
+} PathList;
+
+static void path_list_add(PathList *list, char *path) {
+    if (list->num == list->capacity) {
+        list->capacity = (list->capacity > 0) ? 2 * list->capacity : 64;
+        list->paths = (char**)realloc(list->paths, list->capacity * sizeof(char*));
+    }
+    list->paths[list->num++] = path;
+}
+
+static void path_list_move(PathList *to, PathList *from) {
+    for (unsigned i = 0; i < from->num; ++i) {
+        path_list_add(to, from->paths[i]);
+    }
+    free(from->paths);
+    from->paths = NULL;
+    from->num = from->capacity = 0;
+}
+
+static char *join_path(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir), name_len = strlen(name);
+    char *path = (char*)malloc(dir_len + name_len + 2);
+    memcpy(path, dir, dir_len);
+    if (dir_len == 0 || dir[dir_len - 1] != '/') {
+        path[dir_len++] = '/';
+    }
+    memcpy(path + dir_len, name, name_len + 1);
+    return path;
+}
+
+//traversal: the directories of a level are read in parallel, their subdirectories make the next level;
+//a directory is opened relative to its parent's descriptor, so the paths may be longer than PATH_MAX
+
+//descriptors kept open for the next level (beyond them the directories are opened by their paths)
+#define WALK_FD_MAX 256
+
+typedef struct WalkDir {
+    char *path;
+    //the parent's descriptor (-1 if the directory is opened by its path)
+    int parent_fd;
+    //kept open while the subdirectories are read
+    DIR *dir;
+} WalkDir;
+
+typedef struct WalkLevel {
+    WalkDir *dirs;
+    unsigned num;
+    unsigned capacity;
+} WalkLevel;
+
+static void walk_level_add(WalkLevel *level, char *path, int parent_fd) {
+    if (level->num == level->capacity) {
+        level->capacity = (level->capacity > 0) ? 2 * level->capacity : 64;
+        level->dirs = (WalkDir*)realloc(level->dirs, level->capacity * sizeof(WalkDir));
+    }
+    WalkDir dir = {path, parent_fd, NULL};
+    level->dirs[level->num++] = dir;
+}
+
+static void walk_level_free(WalkLevel *level) {
+    //the descriptors the level kept for its subdirectories are closed
+    for (unsigned i = 0; i < level->num; ++i) {
+        if (level->dirs[i].dir != NULL) {
+            closedir(level->dirs[i].dir);
+        }
+        free(level->dirs[i].path);
+    }
+    free(level->dirs);
+    level->dirs = NULL;
+    level->num = level->capacity = 0;
+}
+
+typedef struct WalkJob {
+    WalkDir *dirs;
+    //results of every worker
+    PathList *files;
+    WalkLevel *subdirs;
+    atomic_uint kept_fd_num;
+} WalkJob;
+
+static DIR *open_walk_dir(const WalkDir *walk_dir) {
+    const char *name = strrchr(walk_dir->path, '/');
+    name = (walk_dir->parent_fd >= 0 && name != NULL) ? name + 1 : walk_dir->path;
+    int dir_fd = (walk_dir->parent_fd >= 0) ? openat(walk_dir->parent_fd, name, O_RDONLY | O_DIRECTORY) :
+                                               open_long_path(walk_dir->path, O_RDONLY | O_DIRECTORY);
+    DIR *dir = (dir_fd >= 0) ? fdopendir(dir_fd) : NULL;
+    if (dir == NULL && dir_fd >= 0) {
+        close(dir_fd);
+    }
+    return dir;
+}
+
+static void walk_task(unsigned task_ix, unsigned worker_ix, void *arg) {
+    WalkJob *job = (WalkJob*)arg;
+    WalkDir *walk_dir = &job->dirs[task_ix];
+    DIR *dir = open_walk_dir(walk_dir);
+    if (dir == NULL) {
+        print_error("\t<<%s>>: failed to open!\n", walk_dir->path);
+        return;
+    }
+    int dir_fd = dirfd(dir);
+    WalkLevel *subdirs = &job->subdirs[worker_ix];
+    unsigned subdir_beg = subdirs->num;
+    struct dirent *entry = NULL;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        int type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            //links are followed to files only, so the traversal can't loop
+            //(the same whether the file system reports the type or not)
+            struct stat entry_stat;
+            if (fstatat(dir_fd, entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            int is_link = S_ISLNK(entry_stat.st_mode);
+            if (is_link && fstatat(dir_fd, entry->d_name, &entry_stat, 0) != 0) {
+                continue;
+            }
+            if (S_ISREG(entry_stat.st_mode)) {
+                type = DT_REG;
+            }
+            else if (S_ISDIR(entry_stat.st_mode) && !is_link) {
+                type = DT_DIR;
+            }
+        }
+        if (type == DT_DIR) {
+            walk_level_add(subdirs, join_path(walk_dir->path, entry->d_name), -1);
+        }
+        else if (type == DT_REG) {
+            path_list_add(&job->files[worker_ix], join_path(walk_dir->path, entry->d_name));
+        }
+    }
+    //the subdirectories are opened relative to the directory while there are descriptors to spare
+    if (subdirs->num > subdir_beg && atomic_fetch_add(&job->kept_fd_num, 1) < WALK_FD_MAX) {
+        walk_dir->dir = dir;
+        for (unsigned i = subdir_beg; i < subdirs->num; ++i) {
+            subdirs->dirs[i].parent_fd = dir_fd;
+        }
+    }
+    else {
+        closedir(dir);
+    }
+}
+
+static int cmp_paths(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void walk_dir(const char *root, PathList *result) {
+    WalkLevel level = {0}, parents = {0};
+    PathList files = {0};
+    walk_level_add(&level, strdup(root), -1);
+    while (level.num > 0) {
+        unsigned worker_num = get_worker_num(level.num);
+        WalkJob job = {level.dirs, NULL, NULL, 0};
+        job.files = (PathList*)calloc(worker_num, sizeof(PathList));
+        job.subdirs = (WalkLevel*)calloc(worker_num, sizeof(WalkLevel));
+        parallel_for(level.num, walk_task, &job);
+        //the level is read: its parents' descriptors aren't needed any more
+        walk_level_free(&parents);
+        parents = level;
+        memset(&level, 0, sizeof(WalkLevel));
+        for (unsigned i = 0; i < worker_num; ++i) {
+            path_list_move(&files, &job.files[i]);
+            for (unsigned j = 0; j < job.subdirs[i].num; ++j) {
+                walk_level_add(&level, job.subdirs[i].dirs[j].path, job.subdirs[i].dirs[j].parent_fd);
+            }
+            free(job.subdirs[i].dirs);
+        }
+        free(job.files);
+        free(job.subdirs);
+    }
+    walk_level_free(&parents);
+    //the order doesn't depend on the scheduling
+    qsort(files.paths, files.num, sizeof(char*), cmp_paths);
+    path_list_move(result, &files);
+}
+
+char **expand_paths(char **paths, unsigned path_num, unsigned *expanded_num) {
+    PathList result = {0};
+    struct stat path_stat;
+    for (unsigned i = 0; i < path_num; ++i) {
+        if (stat_long_path(paths[i], &path_stat) == 0 && S_ISDIR(path_stat.st_mode)) {
+            //the trailing slashes are dropped: "dir/" gives "dir/file"
+            char *root = strdup(paths[i]);
+            size_t len = strlen(root);
+            while (len > 1 && root[len - 1] == '/') {
+                root[--len] = '\0';
+            }
+            walk_dir(root, &result);
+            free(root);
+        }
+        else {
+            path_list_add(&result, strdup(paths[i]));
+        }
+    }
+    *expanded_num = result.num;
+    return result.paths;
+}
+
+void free_paths(char **paths, unsigned path_num) {
+    for (unsigned i = 0; i < path_num; ++i) {
+        free(paths[i]);
+    }
+    free(paths);
+}
@@ -0,0 +1,13 @@
+#ifndef DIR_WALK_H
+#define DIR_WALK_H
+
+//expand the directories among the paths into the regular files below them,
+//found by a parallel traversal (openat() below the parent directory, so the paths may be longer than PATH_MAX)
+//& sorted by name; other paths are kept as they are
+//returns a new array of allocated paths (freed by free_paths())
+
+char **expand_paths(char **paths, unsigned path_num, unsigned *expanded_num);
+
+void free_paths(char **paths, unsigned path_num);
+
+#endif // DIR_WALK_H
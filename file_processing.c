@@ -1,86 +1,375 @@
-#include "file_processing.h"
-
-//checksum
-
-uint32_t crc32_for_byte(uint32_t r) {
-    for (int j = 0; j < 8; ++j) {
-        r = ((r & 1) ? 0 : (uint32_t)0xEDB88320L) ^ r >> 1;
-    }
-    return r ^ (uint32_t)0xFF000000L;
-}
-
-void crc32(const void *data, size_t n_bytes, uint32_t* crc) {
-    static uint32_t table[0x100];
-    if (!*table) {
-        for (size_t i = 0; i < 0x100; ++i) {
-            table[i] = crc32_for_byte(i);
-        }
-    }
-    for (size_t i = 0; i < n_bytes; ++i) {
-        *crc = table[(uint8_t)*crc ^ ((uint8_t*)data)[i]] ^ *crc >> 8;
-    }
-}
-
-uint32_t get_checksum(FILE *file) {
-    static char buf[1L << 15];
-    uint32_t crc = 0;
-    while (!feof(file) && !ferror(file)) {
-        crc32(buf, fread(buf, 1, sizeof(buf), file), &crc);
-    }
-    return crc;
-}
-
-//auxiliary stuff
-
-#define BUF_SIZE 1024
-
-static unsigned char copybuf[BUF_SIZE] = {0};
-
-void file_set_pos(FILE *file, unsigned pos) {
-    fseek(file, pos, SEEK_SET);
-}
-
-unsigned file_copy_block(FILE *from, FILE *to, unsigned block_size) {
-    unsigned bytes_num = 0, bytes_total = 0;
-    for (; block_size > BUF_SIZE; block_size -= BUF_SIZE) {
-        bytes_num = fread(copybuf, sizeof(char), BUF_SIZE, from);
-        fwrite(copybuf, sizeof(char), bytes_num, to);
-        bytes_total += bytes_num;
-        if (bytes_num < BUF_SIZE) {
-            //in-file have reached the EOF
-            return bytes_total;
-        }
-    }
-    //read & write the remainder
-    bytes_num = fread(copybuf, sizeof(char), block_size, from);
-    fwrite(copybuf, sizeof(char), bytes_num, to);
-    bytes_total += bytes_num;
-    return bytes_total;
-}
-
-void file_shift_pos(FILE *file, unsigned shift) {
-    fseek(file, shift, SEEK_CUR);
-}
-
-unsigned concat_files(FILE *to, FILE *from) {
-    unsigned bytes_num = 0, bytes_total = 0;
-    while ((bytes_num = fread(copybuf, sizeof(char), BUF_SIZE, from)) > 0) {
-        fwrite(copybuf, sizeof(char), bytes_num, to);
-        bytes_total += bytes_num;
-    }
-    return bytes_total;
-}
-
-unsigned get_file_size(FILE *file) {
-    fseek(file, 0, SEEK_END);
-    unsigned file_size = ftell(file);
-    rewind(file);
-    return file_size;
-}
-
-void *file_close(FILE *file) {
-    if (file != NULL) {
-        fclose(file);
-    }
-    return NULL;
-}
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "file_processing.h"
+
+//checksum
+
+uint32_t crc32_for_byte(uint32_t r) {
+    for (int j = 0; j < 8; ++j) {
+        r = ((r & 1) ? 0 : (uint32_t)0xEDB88320L) ^ r >> 1;
+    }
+    return r ^ (uint32_t)0xFF000000L;
+}
+
+static uint32_t crc_table[0x100];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void init_crc_table(void) {
+    for (size_t i = 0; i < 0x100; ++i) {
+        crc_table[i] = crc32_for_byte(i);
+    }
+}
+
+void crc32(const void *data, size_t n_bytes, uint32_t* crc) {
+    const uint32_t *table = crc_table;
+    pthread_once(&crc_table_once, init_crc_table);
+    for (size_t i = 0; i < n_bytes; ++i) {
+        *crc = table[(uint8_t)*crc ^ ((uint8_t*)data)[i]] ^ *crc >> 8;
+    }
+}
+
+//appending a zero byte maps the checksum affinely: crc -> col[bits of crc] ^ add
+
+typedef struct CrcZeroOp {
+    uint32_t col[32];
+    uint32_t add;
+} CrcZeroOp;
+
+static uint32_t crc_zero_apply(const CrcZeroOp *op, uint32_t crc) {
+    uint32_t res = op->add;
+    for (unsigned j = 0; crc != 0; ++j, crc >>= 1) {
+        if (crc & 1) {
+            res ^= op->col[j];
+        }
+    }
+    return res;
+}
+
+static void crc_zero_square(CrcZeroOp *op) {
+    //the operator applied twice
+    CrcZeroOp res;
+    for (unsigned j = 0; j < 32; ++j) {
+        res.col[j] = crc_zero_apply(op, op->col[j]) ^ op->add;
+    }
+    res.add = crc_zero_apply(op, op->add);
+    *op = res;
+}
+
+void crc32_zeros(size_t n_bytes, uint32_t *crc) {
+    //the same as crc32() over n_bytes zeros, in log(n_bytes) steps
+    pthread_once(&crc_table_once, init_crc_table);
+    CrcZeroOp op;
+    op.add = crc_table[0];
+    for (unsigned j = 0; j < 32; ++j) {
+        op.col[j] = crc_table[(uint8_t)(1u << j)] ^ (1u << j) >> 8 ^ crc_table[0];
+    }
+    for (; n_bytes > 0; n_bytes >>= 1) {
+        if (n_bytes & 1) {
+            *crc = crc_zero_apply(&op, *crc);
+        }
+        if (n_bytes > 1) {
+            crc_zero_square(&op);
+        }
+    }
+}
+
+uint32_t get_checksum(FILE *file) {
+    static _Thread_local char buf[1L << 15];
+    uint32_t crc = 0;
+    while (!feof(file) && !ferror(file)) {
+        crc32(buf, fread(buf, 1, sizeof(buf), file), &crc);
+    }
+    return crc;
+}
+
+uint32_t get_block_checksum(FILE *file, unsigned size) {
+    static _Thread_local char buf[1L << 15];
+    uint32_t crc = 0;
+    unsigned bytes_num = 0;
+    while (size > 0 && (bytes_num = fread(buf, 1, (size < sizeof(buf)) ? size : sizeof(buf), file)) > 0) {
+        crc32(buf, bytes_num, &crc);
+        size -= bytes_num;
+    }
+    return crc;
+}
+
+//content hash (64-bit FNV-1a)
+
+void hash64(const void *data, size_t n_bytes, uint64_t *hash) {
+    uint64_t h = *hash;
+    for (size_t i = 0; i < n_bytes; ++i) {
+        h ^= ((uint8_t*)data)[i];
+        h *= 0x100000001B3ULL;
+    }
+    *hash = h;
+}
+
+//auxiliary stuff
+
+#define BUF_SIZE 1024
+
+static _Thread_local unsigned char copybuf[BUF_SIZE] = {0};
+
+void file_set_pos(FILE *file, unsigned pos) {
+    fseek(file, pos, SEEK_SET);
+}
+
+unsigned file_copy_block(FILE *from, FILE *to, unsigned block_size) {
+    unsigned bytes_num = 0, bytes_total = 0;
+    for (; block_size > BUF_SIZE; block_size -= BUF_SIZE) {
+        bytes_num = fread(copybuf, sizeof(char), BUF_SIZE, from);
+        fwrite(copybuf, sizeof(char), bytes_num, to);
+        bytes_total += bytes_num;
+        if (bytes_num < BUF_SIZE) {
+            //in-file have reached the EOF
+            return bytes_total;
+        }
+    }
+    //read & write the remainder
+    bytes_num = fread(copybuf, sizeof(char), block_size, from);
+    fwrite(copybuf, sizeof(char), bytes_num, to);
+    bytes_total += bytes_num;
+    return bytes_total;
+}
+
+void file_shift_pos(FILE *file, unsigned shift) {
+    fseek(file, shift, SEEK_CUR);
+}
+
+unsigned concat_files(FILE *to, FILE *from) {
+    unsigned bytes_num = 0, bytes_total = 0;
+    while ((bytes_num = fread(copybuf, sizeof(char), BUF_SIZE, from)) > 0) {
+        fwrite(copybuf, sizeof(char), bytes_num, to);
+        bytes_total += bytes_num;
+    }
+    return bytes_total;
+}
+
+unsigned get_file_size(FILE *file) {
+    fseek(file, 0, SEEK_END);
+    unsigned file_size = ftell(file);
+    rewind(file);
+    return file_size;
+}
+
+unsigned get_bytes_left(FILE *file) {
+    //returns UINT_MAX for streams of unknown size
+    struct stat file_stat;
+    if (fstat(fileno(file), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        return UINT_MAX;
+    }
+    return file_stat.st_size - ftell(file);
+}
+
+void *file_close(FILE *file) {
+    if (file != NULL) {
+        fclose(file);
+    }
+    return NULL;
+}
+
+int file_map(FILE *file, FileMap *map) {
+    //returns 0 if the file can't be read
+    struct stat file_stat;
+    map->data = NULL;
+    map->size = 0;
+    map->mapped = 0;
+    map->fd = fileno(file);
+    fflush(file);
+    if (fstat(fileno(file), &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+        return 0;
+    }
+    map->size = file_stat.st_size;
+    posix_fadvise(map->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    void *data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (data != MAP_FAILED) {
+        madvise(data, map->size, MADV_SEQUENTIAL);
+        map->data = (const unsigned char*)data;
+        map->mapped = 1;
+        return 1;
+    }
+    //file systems without mmap: read the file
+    unsigned char *buf = (unsigned char*)malloc(map->size);
+    rewind(file);
+    if (buf == NULL || fread(buf, sizeof(char), map->size, file) != map->size) {
+        free(buf);
+        map->size = 0;
+        return 0;
+    }
+    map->data = buf;
+    return 1;
+}
+
+void file_unmap(FileMap *map) {
+    if (map->mapped) {
+        munmap((void*)map->data, map->size);
+    }
+    else {
+        free((void*)map->data);
+    }
+    map->data = NULL;
+    map->size = 0;
+}
+
+void file_map_prefetch(const FileMap *map, unsigned pos, unsigned size) {
+    if (map->mapped && size > 0) {
+        //the range is widened to whole pages
+        uintptr_t page_mask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+        uintptr_t beg = (uintptr_t)(map->data + pos) & ~page_mask;
+        madvise((void*)beg, (uintptr_t)(map->data + pos) - beg + size, MADV_WILLNEED);
+        posix_fadvise(map->fd, pos, size, POSIX_FADV_WILLNEED);
+    }
+}
+
+//input files
+
+int open_long_path(const char *path, int flags) {
+    //a path too long for open() is opened a part at a time, every part relative to the directory before it
+    int fd = open(path, flags);
+    if (fd >= 0 || errno != ENAMETOOLONG) {
+        return fd;
+    }
+    int dir_fd = (path[0] == '/') ? open("/", O_RDONLY | O_DIRECTORY) : AT_FDCWD;
+    char *part = (char*)malloc(PATH_MAX);
+    while (dir_fd != -1 && strlen(path) >= PATH_MAX) {
+        //the longest prefix of whole names that fits
+        const char *sep = path + PATH_MAX - 1;
+        while (sep > path && *sep != '/') {
+            --sep;
+        }
+        if (sep == path) {
+            //a name longer than PATH_MAX
+            if (dir_fd != AT_FDCWD) {
+                close(dir_fd);
+            }
+            dir_fd = -1;
+            errno = ENAMETOOLONG;
+            break;
+        }
+        memcpy(part, path, sep - path);
+        part[sep - path] = '\0';
+        int next_fd = openat(dir_fd, part, O_RDONLY | O_DIRECTORY);
+        if (dir_fd != AT_FDCWD) {
+            close(dir_fd);
+        }
+        dir_fd = next_fd;
+        for (path = sep; *path == '/'; ++path) {
+        }
+    }
+    free(part);
+    if (dir_fd == -1) {
+        return -1;
+    }
+    fd = openat(dir_fd, path, flags);
+    if (dir_fd != AT_FDCWD) {
+        close(dir_fd);
+    }
+    return fd;
+}
+
+int stat_long_path(const char *path, struct stat *path_stat) {
+    //the path is opened without being read, so a pipe doesn't block
+    int fd = open_long_path(path, O_PATH);
+    int ok = (fd >= 0 && fstat(fd, path_stat) == 0);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok ? 0 : -1;
+}
+
+FILE *file_open_read(const char *file_name) {
+    int fd = open_long_path(file_name, O_RDONLY);
+    FILE *file = (fd >= 0) ? fdopen(fd, "rb") : NULL;
+    if (file == NULL && fd >= 0) {
+        close(fd);
+    }
+    return file;
+}
+
+//output files
+
+#define OUTPUT_BUF_SIZE (1u << 20)
+#define OUTPUT_BUF_ALIGN 4096
+
+void make_parent_dirs(const char *file_name) {
+    //mkdir -p of the file's directory
+    char *path = strdup(file_name);
+    for (char *sep = strchr(path + 1, '/'); sep != NULL; sep = strchr(sep + 1, '/')) {
+        *sep = '\0';
+        mkdir(path, 0755);
+        *sep = '/';
+    }
+    free(path);
+}
+
+static void set_output_buffer(FILE *file) {
+    //the buffer is reused by the next output of the thread, so an output must be closed before it
+    static _Thread_local char *buf = NULL;
+    if (buf == NULL && posix_memalign((void**)&buf, OUTPUT_BUF_ALIGN, OUTPUT_BUF_SIZE) != 0) {
+        buf = NULL;
+    }
+    if (buf != NULL) {
+        setvbuf(file, buf, _IOFBF, OUTPUT_BUF_SIZE);
+    }
+}
+
+FILE *file_create(const char *file_name, unsigned size) {
+    FILE *file = fopen(file_name, "wb");
+    if (file == NULL && errno == ENOENT) {
+        make_parent_dirs(file_name);
+        file = fopen(file_name, "wb");
+    }
+    if (file == NULL) {
+        return NULL;
+    }
+    if (size > 0) {
+        //file systems that can't preallocate are left as they are
+        fallocate(fileno(file), 0, 0, size);
+    }
+    set_output_buffer(file);
+    return file;
+}
+
+int file_write_hole(FILE *file, unsigned size) {
+    //returns 0 if the file isn't a regular file (nothing is written then)
+    struct stat file_stat;
+    if (fflush(file) != 0 || fstat(fileno(file), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        return 0;
+    }
+    off_t pos = ftello(file);
+    if (pos < 0) {
+        return 0;
+    }
+    //blocks of the file there (e.g. preallocated) are released; where they can't be, the zeros are written
+    if (pos < file_stat.st_size &&
+        fallocate(fileno(file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, size) != 0) {
+        return 0;
+    }
+    //a hole at the end is made by extending the file
+    if (file_stat.st_size < pos + size && ftruncate(fileno(file), pos + size) != 0) {
+        return 0;
+    }
+    return fseeko(file, size, SEEK_CUR) == 0;
+}
+
+FILE *file_open_fd(int fd) {
+    //the descriptor is duplicated, so closing the stream leaves it open
+    int stream_fd = dup(fd);
+    FILE *file = (stream_fd >= 0) ? fdopen(stream_fd, "wb") : NULL;
+    if (file == NULL) {
+        if (stream_fd >= 0) {
+            close(stream_fd);
+        }
+        return NULL;
+    }
+    set_output_buffer(file);
+    return file;
+}
@@ -1,29 +1,89 @@
-#ifndef FILE_PROCESSING_H
-#define FILE_PROCESSING_H
-
-#include <stdio.h>
-#include <stdint.h>
-
-//auxiliary functions
-
-void file_set_pos(FILE *file, unsigned pos);
-
-void file_shift_pos(FILE *file, unsigned shift);
-
-unsigned file_copy_block(FILE *from, FILE *to, unsigned size);
-
-unsigned concat_files(FILE *to, FILE *from);
-
-unsigned get_file_size(FILE *file);
-
-void *file_close(FILE *file);
-
-//checksum
-
-uint32_t crc32_for_byte(uint32_t r);
-
-void crc32(const void *data, size_t n_bytes, uint32_t* crc);
-
-uint32_t get_checksum(FILE *file);
-
-#endif // FILE_PROCESSING_H
+#ifndef FILE_PROCESSING_H
+#define FILE_PROCESSING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+//auxiliary functions
+
+void file_set_pos(FILE *file, unsigned pos);
+
+void file_shift_pos(FILE *file, unsigned shift);
+
+unsigned file_copy_block(FILE *from, FILE *to, unsigned size);
+
+unsigned concat_files(FILE *to, FILE *from);
+
+unsigned get_file_size(FILE *file);
+
+unsigned get_bytes_left(FILE *file);
+
+void *file_close(FILE *file);
+
+//the whole file in memory: mapped for sequential reading, or read if it can't be mapped
+
+typedef struct FileMap {
+    const unsigned char *data;
+    unsigned size;
+    int mapped;
+    int fd;
+} FileMap;
+
+int file_map(FILE *file, FileMap *map);
+
+void file_unmap(FileMap *map);
+
+//start reading a range of the file ahead of its use
+
+void file_map_prefetch(const FileMap *map, unsigned pos, unsigned size);
+
+//open(2) of a path of any length (a path longer than PATH_MAX is opened a directory at a time)
+
+int open_long_path(const char *path, int flags);
+
+//stat(2) of a path of any length
+
+int stat_long_path(const char *path, struct stat *path_stat);
+
+//fopen(file_name, "rb") of a path of any length
+
+FILE *file_open_read(const char *file_name);
+
+//an output of a known size: preallocated (less fragmentation) & written through a large aligned buffer
+//(missing directories of the path are created; a size of 0 isn't preallocated, e.g. for a file with holes)
+
+FILE *file_create(const char *file_name, unsigned size);
+
+//mkdir -p of the file's directory
+
+void make_parent_dirs(const char *file_name);
+
+//size zero bytes written as a hole of a regular file (its blocks aren't allocated); returns 0 with the file
+//position unchanged if the zeros must be written instead
+
+int file_write_hole(FILE *file, unsigned size);
+
+//an output to an open descriptor (e.g. stdout) with the same buffer
+
+FILE *file_open_fd(int fd);
+
+//checksum
+
+uint32_t crc32_for_byte(uint32_t r);
+
+void crc32(const void *data, size_t n_bytes, uint32_t* crc);
+
+void crc32_zeros(size_t n_bytes, uint32_t *crc);
+
+uint32_t get_checksum(FILE *file);
+
+uint32_t get_block_checksum(FILE *file, unsigned size);
+
+//content hash
+
+#define HASH64_INIT 0xCBF29CE484222325ULL
+
+void hash64(const void *data, size_t n_bytes, uint64_t *hash);
+
+#endif // FILE_PROCESSING_H
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include "hash_map.h"
+
+#define MIN_CAPACITY 16
+
+//map create/destroy
+
+static void hashmap_alloc(HashMap *map, unsigned capacity) {
+    map->keys = (uint64_t*)calloc(capacity, sizeof(uint64_t));
+    map->values = (unsigned*)calloc(capacity, sizeof(unsigned));
+    map->used = (char*)calloc(capacity, sizeof(char));
+    map->capacity = capacity;
+    map->size = 0;
+}
+
+HashMap *hashmap_create(unsigned capacity) {
+    HashMap *map = (HashMap*)malloc(sizeof(HashMap));
+    //keep the capacity a power of two
+    unsigned cap = MIN_CAPACITY;
+    while (cap < 2 * capacity) {
+        cap <<= 1;
+    }
+    hashmap_alloc(map, cap);
+    return map;
+}
+
+void *hashmap_destroy(HashMap *map) {
+    if (map != NULL) {
+        free(map->keys);
+        free(map->values);
+        free(map->used);
+        free(map);
+    }
+    return NULL;
+}
+
+//find/insert
+
+static unsigned slot_of(HashMap *map, uint64_t key) {
+    //mix the key bits so that the low bits depend on the whole key
+    uint64_t mix = key ^ (key >> 33);
+    mix *= 0xFF51AFD7ED558CCDULL;
+    mix ^= mix >> 33;
+    unsigned slot = (unsigned)mix & (map->capacity - 1);
+    while (map->used[slot] && map->keys[slot] != key) {
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return slot;
+}
+
+int hashmap_find(HashMap *map, uint64_t key, unsigned *value) {
+    unsigned slot = slot_of(map, key);
+    if (!map->used[slot]) {
+        return 0;
+    }
+    *value = map->values[slot];
+    return 1;
+}
+
+static void hashmap_grow(HashMap *map) {
+    HashMap old = *map;
+    hashmap_alloc(map, old.capacity << 1);
+    for (unsigned i = 0; i < old.capacity; ++i) {
+        if (old.used[i]) {
+            hashmap_insert(map, old.keys[i], old.values[i]);
+        }
+    }
+    free(old.keys);
+    free(old.values);
+    free(old.used);
+}
+
+void hashmap_insert(HashMap *map, uint64_t key, unsigned value) {
+    if (2 * (map->size + 1) > map->capacity) {
+        hashmap_grow(map);
+    }
+    unsigned slot = slot_of(map, key);
+    if (!map->used[slot]) {
+        map->used[slot] = 1;
+        map->keys[slot] = key;
+        ++map->size;
+    }
+    map->values[slot] = value;
+}
@@ -0,0 +1,24 @@
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include <stdint.h>
+
+//open addressing map: 64-bit key -> unsigned value
+
+typedef struct HashMap {
+    uint64_t *keys;
+    unsigned *values;
+    char *used;
+    unsigned capacity;
+    unsigned size;
+} HashMap;
+
+HashMap *hashmap_create(unsigned capacity);
+
+void *hashmap_destroy(HashMap *map);
+
+int hashmap_find(HashMap *map, uint64_t key, unsigned *value);
+
+void hashmap_insert(HashMap *map, uint64_t key, unsigned value);
+
+#endif // HASH_MAP_H
@@ -1,182 +1,973 @@
-#include <string.h>
-#include <limits.h>
-#include "file_processing.h"
-#include "huffman_tree.h"
-#include "binary_buffer.h"
-#include "huffman_coding.h"
-
-//character frequency
-
-unsigned freq_table[ALPH_SIZE] = {0};
-
-void reset_freq_table(void) {
-    memset(freq_table, 0, sizeof(unsigned) * ALPH_SIZE);
-}
-
-unsigned get_sym_freq(unsigned char sym) {
-    return freq_table[sym];
-}
-
-void analyze_file(FILE *fInput) {
-    //the file is supposed to be successfully opened
-    reset_freq_table();
-    int char_num = 0;
-    while ((char_num = read_from_file(fInput)) > 0) {
-        for (int i = 0; i < char_num; ++i) {
-            ++freq_table[inbuf_get_byte()];
-            inbuf_next_byte();
-        }
-    }
-    rewind(fInput);
-}
-
-//read/write to binary buffer
-
-unsigned char read_char_from_inbuf(FILE *fInput) {
-    unsigned char char_val = 0;
-    for (unsigned char bit_mask = 1u; bit_mask > 0; bit_mask <<= 1u) {
-        if (inbuf_get_bit()) {
-            char_val |= bit_mask;
-        }
-        if (inbuf_next_bit()) {
-            read_from_file(fInput);
-        }
-    }
-    return char_val;
-}
-
-void write_char_to_outbuf(FILE *fOutput, unsigned char char_val) {
-    for (unsigned char bit_mask = 1u; bit_mask > 0; bit_mask <<= 1u) {
-        if (char_val & bit_mask) {
-            outbuf_set_bit();
-        }
-        if (outbuf_next_bit()) {
-            write_to_file(fOutput);
-        }
-    }
-}
-
-void write_code_to_outbuf(FILE *fOutput, const char *code) {
-    for (; *code; ++code) {
-        //write a bit to the buffer
-        if (*code == '1') {
-            outbuf_set_bit();
-        }
-        //move to the next buffer's bit
-        if (outbuf_next_bit()) {
-            //dump buffer to the file in case of overflow
-            write_to_file(fOutput);
-        }
-    }
-}
-
-//write/read tree
-
-void write_tree(FILE *fOutput, Tree *node) {
-    //a tree is written to the file by preorder traversal
-    //tree encoding: 0 - go down, 1 + *symbol's 8 bits* - a leaf with a symbol
-    if (node == NULL) {
-        return;
-    }
-    if (node->label.sym <= UCHAR_MAX) {
-        //a leaf has been reached
-        outbuf_set_bit();
-        if (outbuf_next_bit()) {
-            write_to_file(fOutput);
-        }
-        write_char_to_outbuf(fOutput, node->label.sym);
-    }
-    else if (outbuf_next_bit()) {
-        write_to_file(fOutput);
-    }
-    write_tree(fOutput, node->left);
-    write_tree(fOutput, node->right);
-}
-
-Tree *read_tree(FILE *fInput) {
-    Tree *node = tree_create(make_tag(UINT_MAX, 0));
-    unsigned is_leaf = inbuf_get_bit();
-    if (inbuf_next_bit()) {
-        read_from_file(fInput);
-    }
-    if (is_leaf) {
-        //read the leaf's symbol
-        node->label.sym = read_char_from_inbuf(fInput);
-        return node;
-    }
-    //read node's childs
-    node->left = read_tree(fInput);
-    node->right = read_tree(fInput);
-    return node;
-}
-
-//encoding
-
-void encode(FILE *fInput, FILE *fOutput) {
-    inbuf_reset();
-    char *code = NULL;
-    unsigned char_num = 0;
-    while ((char_num = read_from_file(fInput)) > 0) {
-        for (unsigned i = 0; i < char_num; ++i) {
-            code = get_code(inbuf_get_byte());
-            inbuf_next_byte();
-            //write symbol's code to the buffer
-            write_code_to_outbuf(fOutput, code);
-        }
-    }
-    write_to_file(fOutput);
-}
-
-void encode_file(FILE *fInput, FILE *fOutput) {
-    //get characters' frequences & size of the file
-    analyze_file(fInput);
-    //build code tree & table
-    Tree *root = build_code_tree();
-    build_code_table(root);
-    //write file header
-    write_tree(fOutput, root);
-    //write encoded symbols to the buffer
-    encode(fInput, fOutput);
-    //free resources
-    tree_destroy(root);
-}
-
-//decoding
-
-void decode(FILE *fInput, FILE *fOutput, unsigned file_size, Tree *root) {
-    Tree *node = root;
-    outbuf_reset();
-    for (unsigned char_ix = 0; char_ix < file_size; ++char_ix) {
-        while (node->label.sym > UCHAR_MAX) {
-            if (inbuf_get_bit()) {
-                node = node->right;
-            }
-            else {
-                node = node->left;
-            }
-            if (inbuf_next_bit()) {
-                read_from_file(fInput);
-            }
-        }
-        outbuf_set_byte(node->label.sym);
-        if (outbuf_next_byte()) {
-            write_to_file(fOutput);
-        }
-        node = root;
-    }
-    write_to_file(fOutput);
-}
-
-void decode_file(FILE *fInput, FILE *fOutput, unsigned file_size) {
-    Tree *root = NULL;
-    //read file header
-    read_from_file(fInput);
-    if (file_size > 0) {
-        //read the code tree
-        root = read_tree(fInput);
-    }
-    //decode the input file
-    decode(fInput, fOutput, file_size, root);
-    //free resources
-    tree_destroy(root);
-}
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "file_processing.h"
+#include "huffman_tree.h"
+#include "binary_buffer.h"
+#include "huffman_coding.h"
+#include "stats.h"
+#include "trace.h"
+#include "progress.h"
+
+//data of this size & larger is read & written by separate threads
+
+#define PIPELINE_MIN_SIZE (1u << 20)
+
+static void attach_input(FILE *fInput, unsigned size) {
+    //the input in memory (no file) is read in place
+    if (fInput != NULL && size >= PIPELINE_MIN_SIZE) {
+        inbuf_attach(fInput, size);
+    }
+}
+
+static void attach_output(FILE *fOutput, unsigned size) {
+    if (size >= PIPELINE_MIN_SIZE) {
+        outbuf_attach(fOutput);
+    }
+}
+
+static unsigned long long output_pos(FILE *fOutput) {
+    //a null sink has no position
+    return (fOutput != NULL) ? (unsigned long long)ftell(fOutput) : 0;
+}
+
+//character frequency
+
+_Thread_local unsigned freq_table[ALPH_SIZE] = {0};
+
+//content hash & checksum of the last analyzed file
+
+_Thread_local uint64_t file_hash = HASH64_INIT;
+_Thread_local uint32_t file_crc = 0;
+
+void reset_freq_table(void) {
+    memset(freq_table, 0, sizeof(unsigned) * ALPH_SIZE);
+}
+
+unsigned get_sym_freq(unsigned char sym) {
+    return freq_table[sym];
+}
+
+uint64_t get_file_hash(void) {
+    return file_hash;
+}
+
+uint32_t get_file_crc(void) {
+    return file_crc;
+}
+
+//zero runs
+
+//runs of zeros this long & longer are stored as extents instead of codes
+#define ZERO_RUN_MIN 1024
+
+typedef struct ZeroRun {
+    uint32_t pos;
+    uint32_t len;
+} ZeroRun;
+
+//runs of the last analyzed (or decoded) file in order
+_Thread_local ZeroRun *zero_runs = NULL;
+_Thread_local unsigned zero_run_num = 0;
+_Thread_local unsigned zero_run_capacity = 0;
+//zeros at the end of the data analyzed so far
+_Thread_local unsigned zero_tail = 0;
+
+unsigned get_zero_run_num(void) {
+    return zero_run_num;
+}
+
+static void zero_runs_reserve(unsigned run_num) {
+    if (run_num > zero_run_capacity) {
+        zero_run_capacity = (run_num > 2 * zero_run_capacity) ? run_num : 2 * zero_run_capacity;
+        zero_runs = (ZeroRun*)realloc(zero_runs, zero_run_capacity * sizeof(ZeroRun));
+    }
+}
+
+static void end_zero_run(unsigned pos) {
+    //the zeros before pos become a run if there are enough of them; they aren't coded then
+    if (zero_tail >= ZERO_RUN_MIN) {
+        zero_runs_reserve(zero_run_num + 1);
+        zero_runs[zero_run_num].pos = pos - zero_tail;
+        zero_runs[zero_run_num].len = zero_tail;
+        ++zero_run_num;
+        freq_table[0] -= zero_tail;
+    }
+    zero_tail = 0;
+}
+
+static void scan_zero_runs(const unsigned char *data, unsigned len, unsigned pos) {
+    for (unsigned i = 0; i < len; ++i) {
+        if (data[i] == 0) {
+            ++zero_tail;
+        }
+        else if (zero_tail > 0) {
+            end_zero_run(pos + i);
+        }
+    }
+}
+
+//symbol counts by the symbol before (the context) of the last file analyzed by analyze_file_contexts()
+
+_Thread_local unsigned (*context_freq)[ALPH_SIZE] = NULL;
+
+static void count_contexts(const unsigned char *data, unsigned len, unsigned char *prev) {
+    for (unsigned i = 0; i < len; ++i) {
+        ++context_freq[*prev][data[i]];
+        *prev = data[i];
+    }
+}
+
+//the hash & checksum of a sampled file are taken by the encoder
+
+_Thread_local int file_sampled = 0;
+
+static void analyze(FILE *fInput, unsigned size, int contexts) {
+    //the file is supposed to be successfully opened (or NULL with the input in memory)
+    reset_freq_table();
+    file_sampled = 0;
+    file_hash = HASH64_INIT;
+    file_crc = 0;
+    double beg = stats_now();
+    unsigned long long bytes_read = 0;
+    trace_begin("analyze", NULL);
+    attach_input(fInput, size);
+    zero_run_num = 0;
+    zero_tail = 0;
+    //the first symbol is coded in the context of a zero
+    unsigned char prev = 0;
+    int char_num = 0;
+    while ((char_num = read_from_file(fInput)) > 0) {
+        hash64(inbuf_data(), char_num, &file_hash);
+        crc32(inbuf_data(), char_num, &file_crc);
+        for (int i = 0; i < char_num; ++i) {
+            ++freq_table[inbuf_get_byte()];
+            inbuf_next_byte();
+        }
+        scan_zero_runs(inbuf_data(), char_num, bytes_read);
+        if (contexts) {
+            count_contexts(inbuf_data(), char_num, &prev);
+        }
+        bytes_read += char_num;
+    }
+    end_zero_run(bytes_read);
+    inbuf_detach();
+    if (fInput != NULL) {
+        rewind(fInput);
+    }
+    trace_end("analyze");
+    stats_add_phase(PhaseAnalyze, beg, bytes_read, 0);
+}
+
+void analyze_file(FILE *fInput) {
+    analyze(fInput, get_bytes_left(fInput), 0);
+}
+
+//sampled analysis: chunks of this size spread over the file
+#define SAMPLE_CHUNK_SIZE (1u << 16)
+
+unsigned get_sample_size(unsigned file_size, unsigned sample_shift) {
+    unsigned chunk_num = (file_size >> sample_shift) / SAMPLE_CHUNK_SIZE;
+    return (sample_shift > 0) ? chunk_num * SAMPLE_CHUNK_SIZE : 0;
+}
+
+void analyze_file_sampled(FILE *fInput, unsigned sample_shift) {
+    static _Thread_local unsigned char chunk[SAMPLE_CHUNK_SIZE];
+    unsigned file_size = get_bytes_left(fInput);
+    unsigned chunk_num = get_sample_size(file_size, sample_shift) / SAMPLE_CHUNK_SIZE;
+    if (chunk_num == 0) {
+        analyze_file(fInput);
+        return;
+    }
+    reset_freq_table();
+    zero_run_num = 0;
+    file_sampled = 1;
+    double beg = stats_now();
+    unsigned long long bytes_read = 0;
+    trace_begin("analyze", NULL);
+    unsigned step = file_size / chunk_num;
+    for (unsigned i = 0; i < chunk_num; ++i) {
+        file_set_pos(fInput, i * step);
+        unsigned len = fread(chunk, sizeof(char), SAMPLE_CHUNK_SIZE, fInput);
+        if (progress_add(len)) {
+            break;
+        }
+        for (unsigned j = 0; j < len; ++j) {
+            ++freq_table[chunk[j]];
+        }
+        bytes_read += len;
+    }
+    //the symbols missing from the sample get the least count, so that they have codes
+    for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+        if (freq_table[sym] == 0) {
+            freq_table[sym] = 1;
+        }
+    }
+    rewind(fInput);
+    trace_end("analyze");
+    stats_add_phase(PhaseAnalyze, beg, bytes_read, 0);
+}
+
+void analyze_file_contexts(FILE *fInput) {
+    if (context_freq == NULL) {
+        context_freq = (unsigned(*)[ALPH_SIZE])malloc(ALPH_SIZE * ALPH_SIZE * sizeof(unsigned));
+    }
+    memset(context_freq, 0, ALPH_SIZE * ALPH_SIZE * sizeof(unsigned));
+    analyze(fInput, get_bytes_left(fInput), 1);
+}
+
+unsigned get_coded_size(void) {
+    double beg = stats_now();
+    trace_begin("tree", NULL);
+    Tree tree;
+    build_code_tree(&tree);
+    build_code_table(&tree);
+    trace_end("tree");
+    stats_add_phase(PhaseTree, beg, 0, 0);
+    //the tree takes 1 bit per inner node & 9 bits per leaf, the data takes its codes
+    unsigned long long bits = 0;
+    unsigned leaf_num = 0;
+    for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+        if (freq_table[sym] > 0) {
+            bits += (unsigned long long)freq_table[sym] * strlen(get_code(sym)) + 9;
+            ++leaf_num;
+        }
+    }
+    //the runs are stored ahead of the code
+    unsigned run_table_size = (zero_run_num > 0) ? sizeof(uint32_t) + zero_run_num * sizeof(ZeroRun) : 0;
+    if (leaf_num == 0) {
+        //an empty file (or a file of zero runs) is stored without a tree
+        return run_table_size;
+    }
+    bits += leaf_num - 1;
+    return run_table_size + (bits + 7) / 8;
+}
+
+//read/write to binary buffer
+
+unsigned char read_char_from_inbuf(FILE *fInput) {
+    unsigned char char_val = 0;
+    for (unsigned char bit_mask = 1u; bit_mask > 0; bit_mask <<= 1u) {
+        if (inbuf_get_bit()) {
+            char_val |= bit_mask;
+        }
+        if (inbuf_next_bit()) {
+            read_from_file(fInput);
+        }
+    }
+    return char_val;
+}
+
+void write_char_to_outbuf(FILE *fOutput, unsigned char char_val) {
+    for (unsigned char bit_mask = 1u; bit_mask > 0; bit_mask <<= 1u) {
+        if (char_val & bit_mask) {
+            outbuf_set_bit();
+        }
+        if (outbuf_next_bit()) {
+            write_to_file(fOutput);
+        }
+    }
+}
+
+void write_bits_to_outbuf(FILE *fOutput, uint64_t bits, unsigned len) {
+    //the lowest bit is written first
+    for (unsigned i = 0; i < len; ++i, bits >>= 1) {
+        if (bits & 1u) {
+            outbuf_set_bit();
+        }
+        if (outbuf_next_bit()) {
+            write_to_file(fOutput);
+        }
+    }
+}
+
+unsigned read_bits_from_inbuf(FILE *fInput, unsigned len) {
+    unsigned bits = 0;
+    for (unsigned i = 0; i < len; ++i) {
+        if (inbuf_get_bit()) {
+            bits |= 1u << i;
+        }
+        if (inbuf_next_bit()) {
+            read_from_file(fInput);
+        }
+    }
+    return bits;
+}
+
+void write_code_to_outbuf(FILE *fOutput, const char *code) {
+    for (; *code; ++code) {
+        //write a bit to the buffer
+        if (*code == '1') {
+            outbuf_set_bit();
+        }
+        //move to the next buffer's bit
+        if (outbuf_next_bit()) {
+            //dump buffer to the file in case of overflow
+            write_to_file(fOutput);
+        }
+    }
+}
+
+//write/read tree
+
+void write_tree(FILE *fOutput, const Tree *tree, uint16_t ix) {
+    //a tree is written to the file by preorder traversal
+    //tree encoding: 0 - go down, 1 + *symbol's 8 bits* - a leaf with a symbol
+    if (ix == NO_NODE) {
+        return;
+    }
+    const Node *node = &tree->node[ix];
+    if (node->label.sym <= UCHAR_MAX) {
+        //a leaf has been reached
+        outbuf_set_bit();
+        if (outbuf_next_bit()) {
+            write_to_file(fOutput);
+        }
+        write_char_to_outbuf(fOutput, node->label.sym);
+    }
+    else if (outbuf_next_bit()) {
+        write_to_file(fOutput);
+    }
+    write_tree(fOutput, tree, node->left);
+    write_tree(fOutput, tree, node->right);
+}
+
+uint16_t read_tree(FILE *fInput, Tree *tree) {
+    //returns the index of the subtree's root
+    unsigned is_leaf = inbuf_get_bit();
+    if (inbuf_next_bit()) {
+        read_from_file(fInput);
+    }
+    uint16_t ix = tree_add_node(tree, make_tag(UINT_MAX, 0));
+    if (is_leaf || ix == NO_NODE) {
+        //read the leaf's symbol
+        //(a corrupted tree that doesn't fit is cut off here & caught by the checksum)
+        unsigned char sym = read_char_from_inbuf(fInput);
+        if (ix == NO_NODE) {
+            ix = tree->node_num - 1;
+        }
+        tree->node[ix].label.sym = sym;
+        tree->node[ix].left = tree->node[ix].right = NO_NODE;
+        return ix;
+    }
+    //read node's childs
+    uint16_t left = read_tree(fInput, tree);
+    uint16_t right = read_tree(fInput, tree);
+    tree->node[ix].left = left;
+    tree->node[ix].right = right;
+    return ix;
+}
+
+//encoding
+
+void encode(FILE *fInput, FILE *fOutput) {
+    //the zero runs of the analyzed file are skipped
+    inbuf_reset();
+    char *code = NULL;
+    unsigned char_num = 0, pos = 0;
+    const ZeroRun *run = zero_runs, *runs_end = zero_runs + zero_run_num;
+    if (file_sampled) {
+        file_hash = HASH64_INIT;
+        file_crc = 0;
+    }
+    while ((char_num = read_from_file(fInput)) > 0) {
+        if (file_sampled) {
+            hash64(inbuf_data(), char_num, &file_hash);
+            crc32(inbuf_data(), char_num, &file_crc);
+        }
+        for (unsigned i = 0; i < char_num; ) {
+            //code the symbols up to the next run in the buffer
+            unsigned code_end = char_num;
+            if (run != runs_end && run->pos < pos + char_num) {
+                code_end = (run->pos > pos + i) ? run->pos - pos : i;
+            }
+            for (; i < code_end; ++i) {
+                code = get_code(inbuf_get_byte());
+                inbuf_next_byte();
+                //write symbol's code to the buffer
+                write_code_to_outbuf(fOutput, code);
+            }
+            if (code_end < char_num) {
+                //skip the run's zeros in the buffer
+                unsigned run_end = run->pos + run->len - pos;
+                unsigned skip_end = (run_end < char_num) ? run_end : char_num;
+                inbuf_skip_bytes(skip_end - i);
+                i = skip_end;
+                if (run_end <= char_num) {
+                    ++run;
+                }
+            }
+        }
+        pos += char_num;
+    }
+    write_to_file(fOutput);
+}
+
+void encode_file(FILE *fInput, FILE *fOutput) {
+    //get characters' frequences & size of the file
+    analyze_file(fInput);
+    encode_analyzed_file(fInput, fOutput);
+}
+
+static void encode_analyzed(FILE *fInput, FILE *fOutput, unsigned file_size) {
+    //build code tree & table
+    double beg = stats_now();
+    trace_begin("tree", NULL);
+    Tree tree;
+    build_code_tree(&tree);
+    build_code_table(&tree);
+    trace_end("tree");
+    stats_add_phase(PhaseTree, beg, 0, 0);
+    beg = stats_now();
+    trace_begin("encode", NULL);
+    unsigned long long out_beg = output_pos(fOutput);
+    outbuf_reset();
+    attach_input(fInput, file_size);
+    //write file header: the zero runs (written ahead of the pipe's thread) & the tree
+    if (zero_run_num > 0) {
+        fwrite(&zero_run_num, sizeof(uint32_t), 1, fOutput);
+        fwrite(zero_runs, sizeof(ZeroRun), zero_run_num, fOutput);
+    }
+    attach_output(fOutput, file_size);
+    write_tree(fOutput, &tree, tree.root);
+    //write encoded symbols to the buffer
+    encode(fInput, fOutput);
+    //free resources
+    inbuf_detach();
+    outbuf_detach();
+    trace_end("encode");
+    stats_add_phase(PhaseEncode, beg, file_size, output_pos(fOutput) - out_beg);
+}
+
+void encode_analyzed_file(FILE *fInput, FILE *fOutput) {
+    //the frequency table is supposed to be filled by analyze_file()
+    encode_analyzed(fInput, fOutput, get_bytes_left(fInput));
+}
+
+void analyze_memory(const unsigned char *data, unsigned size) {
+    inbuf_attach_memory(data, size);
+    analyze(NULL, size, 0);
+}
+
+void encode_memory(const unsigned char *data, unsigned size, FILE *fOutput) {
+    //the data is read in place twice: by the analysis & by the encoder
+    analyze_memory(data, size);
+    inbuf_attach_memory(data, size);
+    encode_analyzed(NULL, fOutput, size);
+}
+
+//decoding
+
+static unsigned read_symbol(FILE *fInput, const Tree *tree) {
+    const Node *node = &tree->node[tree->root];
+    while (node->label.sym > UCHAR_MAX) {
+        if (inbuf_get_bit()) {
+            node = &tree->node[node->right];
+        }
+        else {
+            node = &tree->node[node->left];
+        }
+        if (inbuf_next_bit()) {
+            read_from_file(fInput);
+        }
+    }
+    return node->label.sym;
+}
+
+void decode(FILE *fInput, FILE *fOutput, unsigned file_size, const Tree *tree,
+            const ZeroRun *runs, unsigned run_num) {
+    //the runs are supposed to be in order & within the file
+    outbuf_reset();
+    unsigned char_ix = 0;
+    for (unsigned run_ix = 0; run_ix <= run_num; ++run_ix) {
+        unsigned code_end = (run_ix < run_num) ? runs[run_ix].pos : file_size;
+        for (; char_ix < code_end; ++char_ix) {
+            outbuf_set_byte(read_symbol(fInput, tree));
+            if (outbuf_next_byte()) {
+                write_to_file(fOutput);
+                //the input of a cancelled coding is cut off
+                if (progress_cancelled()) {
+                    write_to_file(fOutput);
+                    return;
+                }
+            }
+        }
+        if (run_ix < run_num) {
+            outbuf_write_zeros(fOutput, runs[run_ix].len);
+            char_ix += runs[run_ix].len;
+        }
+    }
+    write_to_file(fOutput);
+}
+
+static uint32_t decode_runs(FILE *fInput, FILE *fOutput, unsigned file_size, unsigned comp_size,
+                            const ZeroRun *runs, unsigned run_num) {
+    //returns the checksum of the decoded data
+    Tree tree;
+    tree_reset(&tree);
+    double beg = stats_now();
+    trace_begin("decode", NULL);
+    outbuf_crc_reset();
+    attach_input(fInput, comp_size);
+    attach_output(fOutput, file_size);
+    //read file header
+    read_from_file(fInput);
+    if (file_size > 0) {
+        //read the code tree
+        tree.root = read_tree(fInput, &tree);
+    }
+    //decode the input file
+    decode(fInput, fOutput, file_size, &tree, runs, run_num);
+    //free resources
+    inbuf_detach();
+    outbuf_detach();
+    trace_end("decode");
+    stats_add_phase(PhaseDecode, beg, comp_size, file_size);
+    return outbuf_crc();
+}
+
+uint32_t decode_file(FILE *fInput, FILE *fOutput, unsigned file_size, unsigned comp_size) {
+    return decode_runs(fInput, fOutput, file_size, comp_size, NULL, 0);
+}
+
+static unsigned read_zero_runs(const unsigned char *data, unsigned comp_size, unsigned file_size) {
+    //returns the size of the table of runs, 0 if it's corrupted
+    uint32_t run_num = 0;
+    if (comp_size < sizeof(uint32_t)) {
+        return 0;
+    }
+    memcpy(&run_num, data, sizeof(uint32_t));
+    if (run_num == 0 || run_num > (comp_size - sizeof(uint32_t)) / sizeof(ZeroRun)) {
+        return 0;
+    }
+    zero_runs_reserve(run_num);
+    memcpy(zero_runs, data + sizeof(uint32_t), run_num * sizeof(ZeroRun));
+    zero_run_num = run_num;
+    unsigned long long run_end = 0;
+    for (unsigned i = 0; i < run_num; ++i) {
+        if (zero_runs[i].pos < run_end) {
+            return 0;
+        }
+        run_end = (unsigned long long)zero_runs[i].pos + zero_runs[i].len;
+    }
+    return (run_end <= file_size) ? sizeof(uint32_t) + run_num * sizeof(ZeroRun) : 0;
+}
+
+//adaptive coding
+
+//number of symbols coded between code rebuilds
+#define ADAPT_INTERVAL 4096
+//counts are halved when their sum exceeds the limit
+#define ADAPT_FREQ_LIMIT (1u << 20)
+
+static void adapt_init(void) {
+    //every symbol may appear, so every symbol needs a code
+    for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+        freq_table[sym] = 1;
+    }
+}
+
+static void adapt_rebuild(Tree *tree) {
+    //encoder & decoder rebuild the code at the same points from the same counts
+    unsigned freq_sum = 0;
+    for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+        freq_sum += freq_table[sym];
+    }
+    if (freq_sum > ADAPT_FREQ_LIMIT) {
+        for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+            freq_table[sym] = (freq_table[sym] + 1) >> 1;
+        }
+    }
+    build_code_tree(tree);
+    build_code_table(tree);
+}
+
+unsigned encode_file_adaptive(FILE *fInput, FILE *fOutput) {
+    //returns the size of the input, which is read only once & never rewound
+    //(the code rebuilds are a part of the encoding phase)
+    double beg = stats_now();
+    unsigned long long out_beg = output_pos(fOutput);
+    trace_begin("encode", NULL);
+    adapt_init();
+    file_hash = HASH64_INIT;
+    file_crc = 0;
+    Tree tree;
+    adapt_rebuild(&tree);
+    unsigned file_size = 0, char_num = 0, since_rebuild = 0;
+    //the size of a stream is unknown, so it is always pipelined
+    unsigned bytes_left = get_bytes_left(fInput);
+    attach_input(fInput, bytes_left);
+    attach_output(fOutput, bytes_left);
+    inbuf_reset();
+    outbuf_reset();
+    while ((char_num = read_from_file(fInput)) > 0) {
+        hash64(inbuf_data(), char_num, &file_hash);
+        crc32(inbuf_data(), char_num, &file_crc);
+        for (unsigned i = 0; i < char_num; ++i) {
+            unsigned char sym = inbuf_get_byte();
+            inbuf_next_byte();
+            write_code_to_outbuf(fOutput, get_code(sym));
+            ++freq_table[sym];
+            if (++since_rebuild == ADAPT_INTERVAL) {
+                adapt_rebuild(&tree);
+                since_rebuild = 0;
+            }
+        }
+        file_size += char_num;
+    }
+    write_to_file(fOutput);
+    inbuf_detach();
+    outbuf_detach();
+    trace_end("encode");
+    stats_add_phase(PhaseEncode, beg, file_size, output_pos(fOutput) - out_beg);
+    return file_size;
+}
+
+uint32_t decode_file_adaptive(FILE *fInput, FILE *fOutput, unsigned file_size, unsigned comp_size) {
+    //returns the checksum of the decoded data
+    double beg = stats_now();
+    trace_begin("decode", NULL);
+    outbuf_crc_reset();
+    adapt_init();
+    Tree tree;
+    adapt_rebuild(&tree);
+    unsigned since_rebuild = 0;
+    attach_input(fInput, comp_size);
+    attach_output(fOutput, file_size);
+    read_from_file(fInput);
+    outbuf_reset();
+    for (unsigned char_ix = 0; char_ix < file_size; ++char_ix) {
+        unsigned char sym = read_symbol(fInput, &tree);
+        outbuf_set_byte(sym);
+        if (outbuf_next_byte()) {
+            write_to_file(fOutput);
+            if (progress_cancelled()) {
+                break;
+            }
+        }
+        ++freq_table[sym];
+        if (++since_rebuild == ADAPT_INTERVAL) {
+            adapt_rebuild(&tree);
+            since_rebuild = 0;
+        }
+    }
+    write_to_file(fOutput);
+    inbuf_detach();
+    outbuf_detach();
+    trace_end("decode");
+    stats_add_phase(PhaseDecode, beg, comp_size, file_size);
+    return outbuf_crc();
+}
+
+//context coding: the code of a symbol depends on the symbol before it (order 1)
+//the contexts are clustered, so only a tree per cluster & the cluster of every context are stored
+
+#define CONTEXT_CLUSTER_MAX 16
+#define CONTEXT_CLUSTER_BITS 4
+//a cluster per this many input bytes at most, so that the trees don't outweigh the gain
+#define CONTEXT_CLUSTER_BYTES (1u << 15)
+#define CONTEXT_CLUSTER_ROUNDS 4
+
+typedef struct ContextModel {
+    unsigned cluster_num;
+    unsigned char cluster[ALPH_SIZE];
+    unsigned freq[CONTEXT_CLUSTER_MAX][ALPH_SIZE];
+    Tree tree[CONTEXT_CLUSTER_MAX];
+    //codes by cluster & symbol
+    uint64_t code[CONTEXT_CLUSTER_MAX][ALPH_SIZE];
+    unsigned char code_len[CONTEXT_CLUSTER_MAX][ALPH_SIZE];
+} ContextModel;
+
+static void sum_clusters(ContextModel *model) {
+    memset(model->freq, 0, sizeof(model->freq));
+    for (unsigned ctx = 0; ctx < ALPH_SIZE; ++ctx) {
+        for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+            model->freq[model->cluster[ctx]][sym] += context_freq[ctx][sym];
+        }
+    }
+}
+
+static void cluster_contexts(ContextModel *model, unsigned file_size, unsigned cluster_max) {
+    //k-means: the most frequent contexts are the first centers,
+    //then every context joins the cluster whose code is the shortest for it
+    unsigned total[ALPH_SIZE] = {0}, active_num = 0;
+    for (unsigned ctx = 0; ctx < ALPH_SIZE; ++ctx) {
+        for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+            total[ctx] += context_freq[ctx][sym];
+        }
+        active_num += (total[ctx] > 0);
+    }
+    unsigned cluster_num = 1 + file_size / CONTEXT_CLUSTER_BYTES;
+    cluster_max = (cluster_max < CONTEXT_CLUSTER_MAX) ? cluster_max : CONTEXT_CLUSTER_MAX;
+    cluster_num = (cluster_num < cluster_max) ? cluster_num : cluster_max;
+    cluster_num = (cluster_num < active_num) ? cluster_num : (active_num > 0) ? active_num : 1;
+    memset(model->freq, 0, sizeof(model->freq));
+    char is_center[ALPH_SIZE] = {0};
+    for (unsigned k = 0; k < cluster_num && k < active_num; ++k) {
+        unsigned center = 0;
+        for (unsigned ctx = 0; ctx < ALPH_SIZE; ++ctx) {
+            if (!is_center[ctx] && (is_center[center] || total[ctx] > total[center])) {
+                center = ctx;
+            }
+        }
+        is_center[center] = 1;
+        memcpy(model->freq[k], context_freq[center], sizeof(model->freq[k]));
+    }
+    memset(model->cluster, 0, sizeof(model->cluster));
+    for (unsigned round = 0; round < CONTEXT_CLUSTER_ROUNDS && cluster_num > 1; ++round) {
+        //code lengths of the clusters, smoothed, so that any symbol has a length
+        static _Thread_local float code_len[CONTEXT_CLUSTER_MAX][ALPH_SIZE];
+        for (unsigned k = 0; k < cluster_num; ++k) {
+            unsigned freq_sum = 0;
+            for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+                freq_sum += model->freq[k][sym];
+            }
+            float sum_len = log2f(freq_sum + ALPH_SIZE / 2);
+            for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+                code_len[k][sym] = sum_len - log2f(model->freq[k][sym] + 0.5f);
+            }
+        }
+        for (unsigned ctx = 0; ctx < ALPH_SIZE; ++ctx) {
+            float best_len = 0;
+            for (unsigned k = 0; k < cluster_num && total[ctx] > 0; ++k) {
+                float len = 0;
+                for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+                    if (context_freq[ctx][sym] > 0) {
+                        len += context_freq[ctx][sym] * code_len[k][sym];
+                    }
+                }
+                if (k == 0 || len < best_len) {
+                    best_len = len;
+                    model->cluster[ctx] = k;
+                }
+            }
+        }
+        sum_clusters(model);
+    }
+    if (cluster_num == 1) {
+        sum_clusters(model);
+    }
+    //clusters left empty are dropped (an empty tree isn't stored), unused contexts are left in the first one
+    unsigned char new_ix[CONTEXT_CLUSTER_MAX] = {0};
+    model->cluster_num = 0;
+    for (unsigned k = 0; k < cluster_num; ++k) {
+        unsigned freq_sum = 0;
+        for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+            freq_sum += model->freq[k][sym];
+        }
+        if (freq_sum > 0) {
+            new_ix[k] = model->cluster_num;
+            memmove(model->freq[model->cluster_num++], model->freq[k], sizeof(model->freq[k]));
+        }
+    }
+    for (unsigned ctx = 0; ctx < ALPH_SIZE; ++ctx) {
+        model->cluster[ctx] = new_ix[model->cluster[ctx]];
+    }
+}
+
+static ContextModel *build_context_model(unsigned cluster_max, unsigned long long *size) {
+    //the model of the file analyzed by analyze_file_contexts() & the exact size of the file coded by it
+    double beg = stats_now();
+    trace_begin("tree", NULL);
+    unsigned file_size = 0, order0_freq[ALPH_SIZE];
+    for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+        file_size += freq_table[sym];
+    }
+    ContextModel *model = (ContextModel*)malloc(sizeof(ContextModel));
+    cluster_contexts(model, file_size, cluster_max);
+    //the trees are built from the clusters' counts
+    memcpy(order0_freq, freq_table, sizeof(order0_freq));
+    unsigned long long bits = 8 + ALPH_SIZE * CONTEXT_CLUSTER_BITS;
+    for (unsigned k = 0; k < model->cluster_num; ++k) {
+        memcpy(freq_table, model->freq[k], sizeof(order0_freq));
+        build_code_tree(&model->tree[k]);
+        build_code_table(&model->tree[k]);
+        for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+            const char *code = get_code(sym);
+            unsigned len = 0;
+            model->code[k][sym] = 0;
+            for (; code[len]; ++len) {
+                model->code[k][sym] |= (uint64_t)(code[len] == '1') << len;
+            }
+            model->code_len[k][sym] = len;
+            bits += (unsigned long long)model->freq[k][sym] * len;
+        }
+        //a leaf takes 9 bits, an inner node takes 1
+        if (model->tree[k].node_num > 0) {
+            bits += 10 * (model->tree[k].node_num + 1) / 2 - 1;
+        }
+    }
+    memcpy(freq_table, order0_freq, sizeof(order0_freq));
+    *size = (bits + 7) / 8;
+    trace_end("tree");
+    stats_add_phase(PhaseTree, beg, 0, 0);
+    return model;
+}
+
+unsigned get_context_coded_size(unsigned cluster_max) {
+    //files with zero runs & empty files are coded by encode_analyzed_file()
+    unsigned long long size = 0;
+    if (context_freq == NULL || zero_run_num > 0 || get_coded_size() == 0) {
+        return UINT_MAX;
+    }
+    free(build_context_model(cluster_max, &size));
+    return (size < UINT_MAX) ? size : UINT_MAX;
+}
+
+CodingMethod encode_analyzed_file_contexts(FILE *fInput, FILE *fOutput, unsigned cluster_max) {
+    unsigned long long context_size = 0;
+    ContextModel *model = (zero_run_num == 0) ? build_context_model(cluster_max, &context_size) : NULL;
+    if (model == NULL || context_size >= get_coded_size()) {
+        free(model);
+        encode_analyzed_file(fInput, fOutput);
+        return (zero_run_num > 0) ? SparseCoding : StaticCoding;
+    }
+    double beg = stats_now();
+    trace_begin("encode", NULL);
+    unsigned long long out_beg = output_pos(fOutput);
+    unsigned file_size = get_bytes_left(fInput);
+    outbuf_reset();
+    attach_input(fInput, file_size);
+    attach_output(fOutput, file_size);
+    //write file header: the clusters of the contexts & the trees
+    write_bits_to_outbuf(fOutput, model->cluster_num, 8);
+    for (unsigned ctx = 0; ctx < ALPH_SIZE; ++ctx) {
+        write_bits_to_outbuf(fOutput, model->cluster[ctx], CONTEXT_CLUSTER_BITS);
+    }
+    for (unsigned k = 0; k < model->cluster_num; ++k) {
+        write_tree(fOutput, &model->tree[k], model->tree[k].root);
+    }
+    //write encoded symbols to the buffer
+    inbuf_reset();
+    unsigned char_num = 0;
+    unsigned char prev = 0;
+    while ((char_num = read_from_file(fInput)) > 0) {
+        for (unsigned i = 0; i < char_num; ++i) {
+            unsigned char sym = inbuf_get_byte();
+            inbuf_next_byte();
+            unsigned k = model->cluster[prev];
+            write_bits_to_outbuf(fOutput, model->code[k][sym], model->code_len[k][sym]);
+            prev = sym;
+        }
+    }
+    write_to_file(fOutput);
+    //free resources
+    inbuf_detach();
+    outbuf_detach();
+    free(model);
+    trace_end("encode");
+    stats_add_phase(PhaseEncode, beg, file_size, output_pos(fOutput) - out_beg);
+    return ContextCoding;
+}
+
+//the decoding trees are kept small to stay in the cache:
+//a node is the pair of its children, a child is a node's index or a leaf's symbol with the flag
+#define CONTEXT_LEAF 0x8000u
+
+typedef struct ContextDecoder {
+    unsigned char cluster[ALPH_SIZE];
+    uint16_t root[CONTEXT_CLUSTER_MAX];
+    uint16_t child[CONTEXT_CLUSTER_MAX][TREE_SIZE][2];
+} ContextDecoder;
+
+static uint16_t flatten_tree(const Tree *tree, uint16_t (*child)[2]) {
+    //returns the root's index
+    for (unsigned ix = 0; ix < tree->node_num; ++ix) {
+        const Node *node = &tree->node[ix];
+        if (node->label.sym > UCHAR_MAX) {
+            const Node *left = &tree->node[node->left], *right = &tree->node[node->right];
+            child[ix][0] = (left->label.sym <= UCHAR_MAX) ? CONTEXT_LEAF | left->label.sym : node->left;
+            child[ix][1] = (right->label.sym <= UCHAR_MAX) ? CONTEXT_LEAF | right->label.sym : node->right;
+        }
+    }
+    if (tree->root == NO_NODE || tree->node[tree->root].label.sym <= UCHAR_MAX) {
+        //a single symbol still takes a bit
+        unsigned sym = (tree->root == NO_NODE) ? 0 : tree->node[tree->root].label.sym;
+        child[0][0] = child[0][1] = CONTEXT_LEAF | sym;
+        return 0;
+    }
+    return tree->root;
+}
+
+uint32_t decode_file_contexts(FILE *fInput, FILE *fOutput, unsigned file_size, unsigned comp_size) {
+    //returns the checksum of the decoded data
+    double beg = stats_now();
+    trace_begin("decode", NULL);
+    outbuf_crc_reset();
+    attach_input(fInput, comp_size);
+    attach_output(fOutput, file_size);
+    //read file header
+    read_from_file(fInput);
+    ContextDecoder *decoder = (ContextDecoder*)malloc(sizeof(ContextDecoder));
+    unsigned cluster_num = read_bits_from_inbuf(fInput, 8);
+    if (cluster_num == 0 || cluster_num > CONTEXT_CLUSTER_MAX) {
+        //a corrupted header is caught by the checksum
+        cluster_num = 1;
+    }
+    for (unsigned ctx = 0; ctx < ALPH_SIZE; ++ctx) {
+        decoder->cluster[ctx] = read_bits_from_inbuf(fInput, CONTEXT_CLUSTER_BITS) % cluster_num;
+    }
+    Tree tree;
+    for (unsigned k = 0; k < cluster_num; ++k) {
+        tree_reset(&tree);
+        tree.root = read_tree(fInput, &tree);
+        decoder->root[k] = flatten_tree(&tree, decoder->child[k]);
+    }
+    //decode the input file
+    outbuf_reset();
+    unsigned char prev = 0;
+    for (unsigned char_ix = 0; char_ix < file_size; ++char_ix) {
+        unsigned k = decoder->cluster[prev];
+        const uint16_t (*child)[2] = decoder->child[k];
+        unsigned ix = decoder->root[k];
+        do {
+            ix = child[ix][inbuf_get_bit() != 0];
+            if (inbuf_next_bit()) {
+                read_from_file(fInput);
+            }
+        } while (!(ix & CONTEXT_LEAF));
+        prev = ix & UCHAR_MAX;
+        outbuf_set_byte(prev);
+        if (outbuf_next_byte()) {
+            write_to_file(fOutput);
+            if (progress_cancelled()) {
+                break;
+            }
+        }
+    }
+    write_to_file(fOutput);
+    //free resources
+    free(decoder);
+    inbuf_detach();
+    outbuf_detach();
+    trace_end("decode");
+    stats_add_phase(PhaseDecode, beg, comp_size, file_size);
+    return outbuf_crc();
+}
+
+uint32_t decode_memory(const unsigned char *data, FILE *fOutput, unsigned file_size, unsigned comp_size,
+                       CodingMethod method) {
+    //returns the checksum of the decoded data
+    if (method == SparseCoding) {
+        unsigned table_size = read_zero_runs(data, comp_size, file_size);
+        if (table_size == 0) {
+            //a corrupted table: the file is decoded as zeros, which the checksum catches
+            zero_runs_reserve(1);
+            zero_runs[0].pos = 0;
+            zero_runs[0].len = file_size;
+            zero_run_num = (file_size > 0) ? 1 : 0;
+            table_size = comp_size;
+        }
+        inbuf_attach_memory(data + table_size, comp_size - table_size);
+        return decode_runs(NULL, fOutput, file_size, comp_size - table_size, zero_runs, zero_run_num);
+    }
+    inbuf_attach_memory(data, comp_size);
+    if (method == AdaptiveCoding) {
+        return decode_file_adaptive(NULL, fOutput, file_size, comp_size);
+    }
+    if (method == ContextCoding) {
+        return decode_file_contexts(NULL, fOutput, file_size, comp_size);
+    }
+    return decode_file(NULL, fOutput, file_size, comp_size);
+}
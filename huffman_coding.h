@@ -1,16 +1,90 @@
-#ifndef HUFFMAN_CODING_H
-#define HUFFMAN_CODING_H
-
-#include <stdio.h>
-
-#define ALPH_SIZE 256
-
-void analyze_file(FILE *fInput);
-
-void encode_file(FILE *fInput, FILE *fOutput);
-
-void decode_file(FILE *fInput, FILE *fOutput, unsigned file_size);
-
-unsigned get_sym_freq(unsigned char sym);
-
-#endif // HUFFMAN_CODING_H
+#ifndef HUFFMAN_CODING_H
+#define HUFFMAN_CODING_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define ALPH_SIZE 256
+
+//the coding reports its progress & may be cancelled through progress_start() (progress.h);
+//after a cancelled coding the output is incomplete & progress_cancelled() returns nonzero
+
+typedef enum CodingMethod {
+    //two passes: the code tree is built from the whole file & stored
+    StaticCoding,
+    //one pass: the code is rebuilt periodically from running counts
+    AdaptiveCoding,
+    //StaticCoding of the data between long runs of zeros, which are stored as extents ahead of the code
+    //(& are written as holes when decoded to a regular file)
+    SparseCoding,
+    //two passes: a code tree per cluster of contexts (the symbols before), chosen by the symbol before
+    ContextCoding
+} CodingMethod;
+
+void analyze_file(FILE *fInput);
+
+//a faster analysis by a sample of about 1/2^sample_shift of the file (in chunks spread over it):
+//symbols missing from the sample still get codes, the hash & checksum are taken by encode_analyzed_file()
+
+void analyze_file_sampled(FILE *fInput, unsigned sample_shift);
+
+//bytes analyze_file_sampled() reads of a file of the size (0 if the file is too small to be sampled)
+
+unsigned get_sample_size(unsigned file_size, unsigned sample_shift);
+
+//long runs of zeros found by analyze_file(): encode_analyzed_file() writes SparseCoding if there are any
+
+unsigned get_zero_run_num(void);
+
+//order-1 coding: the analysis counts the symbols by context as well,
+//the encoder writes ContextCoding if it's smaller than encode_analyzed_file() would write & returns the method
+
+void analyze_file_contexts(FILE *fInput);
+
+CodingMethod encode_analyzed_file_contexts(FILE *fInput, FILE *fOutput, unsigned cluster_max);
+
+uint32_t decode_file_contexts(FILE *fInput, FILE *fOutput, unsigned file_size, unsigned comp_size);
+
+void encode_file(FILE *fInput, FILE *fOutput);
+
+void encode_analyzed_file(FILE *fInput, FILE *fOutput);
+
+//analyze_file() of data in memory (e.g. for get_coded_size())
+
+void analyze_memory(const unsigned char *data, unsigned size);
+
+//encode_file() of data in memory (StaticCoding, or SparseCoding if get_zero_run_num() > 0)
+
+void encode_memory(const unsigned char *data, unsigned size, FILE *fOutput);
+
+unsigned encode_file_adaptive(FILE *fInput, FILE *fOutput);
+
+uint32_t decode_file(FILE *fInput, FILE *fOutput, unsigned file_size, unsigned comp_size);
+
+uint32_t decode_file_adaptive(FILE *fInput, FILE *fOutput, unsigned file_size, unsigned comp_size);
+
+//decode data in memory (e.g. a mapped archive) coded by any method
+
+uint32_t decode_memory(const unsigned char *data, FILE *fOutput, unsigned file_size, unsigned comp_size,
+                       CodingMethod method);
+
+unsigned get_sym_freq(unsigned char sym);
+
+uint64_t get_file_hash(void);
+
+uint32_t get_file_crc(void);
+
+//appends the code (a string of '0' & '1', see get_code()) to the output buffer, which is written to fOutput
+//when it's full; a primitive of the encoders (benchmarked by bench/micro_bench.c)
+
+void write_code_to_outbuf(FILE *fOutput, const char *code);
+
+//the exact size encode_analyzed_file() would write for the last analyzed file, from the code lengths
+
+unsigned get_coded_size(void);
+
+//the same for ContextCoding after analyze_file_contexts() (UINT_MAX if the file isn't coded by contexts)
+
+unsigned get_context_coded_size(unsigned cluster_max);
+
+#endif // HUFFMAN_CODING_H
@@ -1,127 +1,149 @@
-#include <stdlib.h>
-#include <string.h>
-#include "priority_queue.h"
-#include "huffman_tree.h"
-#include "huffman_coding.h"
-
-#define MAX_CODE_LEN 64
-
-char code_table[ALPH_SIZE][MAX_CODE_LEN + 1] = {0};
-
-//huffman tree
-
-Tag make_tag(unsigned sym, unsigned freq) {
-    Tag t = {.sym = sym, .freq = freq};
-    return t;
-}
-
-Tree *tree_create(Tag label) {
-    Tree *node = (Tree*)malloc(sizeof(Tree));
-    if (node != NULL) {
-        node->label = label;
-        node->left = node->right = NULL;
-    }
-    return node;
-}
-
-static void init_heap(Heap *heap) {
-    Tag label;
-    Tree *node = NULL;
-    for (unsigned sym = 0, freq = 0; sym < ALPH_SIZE; ++sym) {
-        freq = get_sym_freq(sym);
-        if (freq > 0) {
-            label = make_tag(sym, freq);
-            node = tree_create(label);
-            heap_insert(heap, node);
-        }
-    }
-}
-
-Tree *build_code_tree(void) {
-    Tag label;
-    Tree *node = NULL;
-    Tree *node1 = NULL, *node2 = NULL;
-    //init heap
-    Heap *heap = heap_create(ALPH_SIZE);
-    init_heap(heap);
-    //build tree
-    while (!heap_empty(heap)) {
-        if (heap_size(heap) == 1) {
-            //huffman tree has been built
-            return heap_extract(heap);
-        }
-        //extract two nodes
-        node1 = heap_extract(heap);
-        node2 = heap_extract(heap);
-        //identify node1 and node2
-        label = make_tag(UINT_MAX, node1->label.freq + node2->label.freq);
-        node = tree_create(label);
-        //connect nodes
-        node->left = node1;
-        node->right = node2;
-        //push to the heap
-        heap_insert(heap, node);
-    }
-    //destroy heap
-    heap_destroy(heap);
-    return NULL;
-}
-
-void tree_traversal(Tree *node) {
-    //fill code table while traversing the tree
-    static char buf[MAX_CODE_LEN + 1] = {0};
-    static int depth = -1;
-
-    ++depth;
-    if (node->left == NULL && node->right == NULL) {
-        //a node with a symbol has been found
-        snprintf(code_table[node->label.sym], MAX_CODE_LEN + 1, buf);
-        --depth;
-        return;
-    }
-    buf[depth] = '0'; buf[depth + 1] = '\0';
-    tree_traversal(node->left);
-    buf[depth] = '1'; buf[depth + 1] = '\0';
-    tree_traversal(node->right);
-    --depth;
-}
-
-void tree_destroy(Tree *root) {
-    if (root != NULL) {
-        tree_destroy(root->left);
-        tree_destroy(root->right);
-        free(root);
-    }
-}
-
-//code table
-
-void reset_code_table(void) {
-    memset(code_table, 0, ALPH_SIZE * (MAX_CODE_LEN + 1));
-}
-
-void build_code_table(Tree *root) {
-    reset_code_table();
-    if (root == NULL) {
-        return;
-    }
-    if (root->left == NULL && root->right == NULL) {
-        //the case of a single node in the tree
-        snprintf(code_table[root->label.sym], MAX_CODE_LEN + 1, "0");
-        return;
-    }
-    tree_traversal(root);
-}
-
-char *get_code(unsigned char sym) {
-    return code_table[sym];
-}
-
-void print_code_table(void) {
-    for (unsigned i = 0; i < ALPH_SIZE; ++i) {
-        if (code_table[i][0]) {
-            printf("%c) %s\n", i, code_table[i]);
-        }
-    }
-    printf("\n");
-}
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+#include "huffman_tree.h"
+#include "huffman_coding.h"
+
+#define MAX_CODE_LEN 64
+
+_Thread_local char code_table[ALPH_SIZE][MAX_CODE_LEN + 1] = {0};
+
+//huffman tree
+
+Tag make_tag(unsigned sym, unsigned freq) {
+    Tag t = {.sym = sym, .freq = freq};
+    return t;
+}
+
+void tree_reset(Tree *tree) {
+    tree->node_num = 0;
+    tree->root = NO_NODE;
+}
+
+uint16_t tree_add_node(Tree *tree, Tag label) {
+    if (tree->node_num == TREE_SIZE) {
+        return NO_NODE;
+    }
+    Node *node = &tree->node[tree->node_num];
+    node->label = label;
+    node->left = node->right = NO_NODE;
+    return tree->node_num++;
+}
+
+static unsigned sort_leaves(Tree *tree) {
+    //the leaves are placed at the beginning of the tree by frequency (by symbol for equal frequencies)
+    //LSD radix sort by the frequency's bytes: linear & stable
+    uint16_t syms[2][ALPH_SIZE];
+    unsigned sym_num = 0;
+    for (unsigned sym = 0; sym < ALPH_SIZE; ++sym) {
+        if (get_sym_freq(sym) > 0) {
+            syms[0][sym_num++] = sym;
+        }
+    }
+    unsigned from = 0;
+    for (unsigned shift = 0; shift < 32; shift += 8) {
+        unsigned count[UCHAR_MAX + 2] = {0};
+        for (unsigned i = 0; i < sym_num; ++i) {
+            ++count[((get_sym_freq(syms[from][i]) >> shift) & UCHAR_MAX) + 1];
+        }
+        if (count[1] == sym_num) {
+            //all the digits are zero: nothing to reorder
+            continue;
+        }
+        for (unsigned i = 1; i <= UCHAR_MAX; ++i) {
+            count[i + 1] += count[i];
+        }
+        for (unsigned i = 0; i < sym_num; ++i) {
+            uint16_t sym = syms[from][i];
+            syms[1 - from][count[(get_sym_freq(sym) >> shift) & UCHAR_MAX]++] = sym;
+        }
+        from = 1 - from;
+    }
+    for (unsigned i = 0; i < sym_num; ++i) {
+        tree_add_node(tree, make_tag(syms[from][i], get_sym_freq(syms[from][i])));
+    }
+    return sym_num;
+}
+
+void build_code_tree(Tree *tree) {
+    //two queues: the sorted leaves & the inner nodes, which are created in nondecreasing order
+    //so the two least frequent nodes are always at the queues' heads
+    tree_reset(tree);
+    unsigned leaf_num = sort_leaves(tree);
+    if (leaf_num == 0) {
+        return;
+    }
+    unsigned leaf_ix = 0, inner_ix = leaf_num;
+    while (tree->node_num < 2 * leaf_num - 1) {
+        uint16_t child[2];
+        for (unsigned i = 0; i < 2; ++i) {
+            //take a leaf if it is not more frequent than the first inner node
+            if (leaf_ix < leaf_num &&
+                (inner_ix == tree->node_num || tree->node[leaf_ix].label.freq <= tree->node[inner_ix].label.freq)) {
+                child[i] = leaf_ix++;
+            }
+            else {
+                child[i] = inner_ix++;
+            }
+        }
+        uint16_t ix = tree_add_node(tree, make_tag(UINT_MAX, tree->node[child[0]].label.freq +
+                                                             tree->node[child[1]].label.freq));
+        tree->node[ix].left = child[0];
+        tree->node[ix].right = child[1];
+    }
+    //the last node is the root
+    tree->root = tree->node_num - 1;
+}
+
+void tree_traversal(const Tree *tree, uint16_t ix) {
+    //fill code table while traversing the tree
+    static _Thread_local char buf[MAX_CODE_LEN + 1] = {0};
+    static _Thread_local int depth = -1;
+
+    const Node *node = &tree->node[ix];
+    ++depth;
+    if (node->left == NO_NODE && node->right == NO_NODE) {
+        //a node with a symbol has been found
+        snprintf(code_table[node->label.sym], MAX_CODE_LEN + 1, "%s", buf);
+        --depth;
+        return;
+    }
+    buf[depth] = '0'; buf[depth + 1] = '\0';
+    tree_traversal(tree, node->left);
+    buf[depth] = '1'; buf[depth + 1] = '\0';
+    tree_traversal(tree, node->right);
+    --depth;
+}
+
+//code table
+
+void reset_code_table(void) {
+    memset(code_table, 0, ALPH_SIZE * (MAX_CODE_LEN + 1));
+}
+
+void build_code_table(const Tree *tree) {
+    reset_code_table();
+    if (tree->root == NO_NODE) {
+        return;
+    }
+    const Node *root = &tree->node[tree->root];
+    if (root->left == NO_NODE && root->right == NO_NODE) {
+        //the case of a single node in the tree
+        snprintf(code_table[root->label.sym], MAX_CODE_LEN + 1, "0");
+        return;
+    }
+    tree_traversal(tree, tree->root);
+}
+
+char *get_code(unsigned char sym) {
+    return code_table[sym];
+}
+
+void print_code_table(void) {
+    for (unsigned i = 0; i < ALPH_SIZE; ++i) {
+        if (code_table[i][0]) {
+            printf("%c) %s\n", i, code_table[i]);
+        }
+    }
+    printf("\n");
+}
@@ -1,29 +1,45 @@
-#ifndef HUFFMAN_TREE_H
-#define HUFFMAN_TREE_H
-
-typedef struct Tag {
-    unsigned sym;
-    unsigned freq;
-} Tag;
-
-Tag make_tag(unsigned sym, unsigned freq);
-
-typedef struct Tree {
-    Tag label;
-    //left <=> 0, right <=> 1
-    struct Tree *left, *right;
-} Tree;
-
-Tree *tree_create(Tag label);
-
-Tree *build_code_tree(void);
-
-void build_code_table(Tree *root);
-
-char *get_code(unsigned char sym);
-
-void print_code_table(void);
-
-void tree_destroy(Tree *root);
-
-#endif // HUFFMAN_TREE_H
+#ifndef HUFFMAN_TREE_H
+#define HUFFMAN_TREE_H
+
+#include <stdint.h>
+
+//a tree of 256 leaves has 511 nodes
+#define TREE_SIZE 511
+#define NO_NODE UINT16_MAX
+
+typedef struct Tag {
+    unsigned sym;
+    unsigned freq;
+} Tag;
+
+Tag make_tag(unsigned sym, unsigned freq);
+
+typedef struct Node {
+    Tag label;
+    //left <=> 0, right <=> 1 (indices of the tree's nodes)
+    uint16_t left, right;
+} Node;
+
+//all the nodes are kept in the tree itself, so a tree needs no allocations
+
+typedef struct Tree {
+    Node node[TREE_SIZE];
+    uint16_t node_num;
+    uint16_t root;
+} Tree;
+
+void tree_reset(Tree *tree);
+
+//returns the index of the new node or NO_NODE if the tree is full
+
+uint16_t tree_add_node(Tree *tree, Tag label);
+
+void build_code_tree(Tree *tree);
+
+void build_code_table(const Tree *tree);
+
+char *get_code(unsigned char sym);
+
+void print_code_table(void);
+
+#endif // HUFFMAN_TREE_H
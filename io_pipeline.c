@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "io_pipeline.h"
+
+struct Pipe {
+    FILE *file;
+    unsigned char *block[PIPE_BLOCK_NUM];
+    unsigned block_len[PIPE_BLOCK_NUM];
+    //number of blocks filled by the producer & released by the consumer
+    unsigned filled;
+    unsigned consumed;
+    //reader: bytes left to read & the consumer holds a block
+    unsigned limit;
+    int holding;
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+//block cache: blocks are reused by the following pipes
+
+#define CACHE_SIZE (2 * PIPE_BLOCK_NUM)
+
+static unsigned char *block_cache[CACHE_SIZE];
+static unsigned cached_num = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned char *block_alloc(void) {
+    unsigned char *block = NULL;
+    pthread_mutex_lock(&cache_lock);
+    if (cached_num > 0) {
+        block = block_cache[--cached_num];
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return (block != NULL) ? block : (unsigned char*)malloc(PIPE_BLOCK_SIZE);
+}
+
+static void block_free(unsigned char *block) {
+    pthread_mutex_lock(&cache_lock);
+    if (cached_num < CACHE_SIZE) {
+        block_cache[cached_num++] = block;
+        block = NULL;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    free(block);
+}
+
+//pipe create/destroy
+
+static Pipe *pipe_create(FILE *file, unsigned limit, void *(*routine)(void*)) {
+    Pipe *pipe = (Pipe*)calloc(1, sizeof(Pipe));
+    pipe->file = file;
+    pipe->limit = limit;
+    for (unsigned i = 0; i < PIPE_BLOCK_NUM; ++i) {
+        pipe->block[i] = block_alloc();
+    }
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->cond, NULL);
+    if (pthread_create(&pipe->thread, NULL, routine, pipe) != 0) {
+        //the caller falls back to synchronous I/O
+        pipe->stop = 1;
+        pipe_close(pipe);
+        return NULL;
+    }
+    return pipe;
+}
+
+void *pipe_close(Pipe *pipe) {
+    if (pipe == NULL) {
+        return NULL;
+    }
+    if (!pipe->stop) {
+        pthread_mutex_lock(&pipe->lock);
+        pipe->stop = 1;
+        pthread_cond_broadcast(&pipe->cond);
+        pthread_mutex_unlock(&pipe->lock);
+        pthread_join(pipe->thread, NULL);
+    }
+    for (unsigned i = 0; i < PIPE_BLOCK_NUM; ++i) {
+        block_free(pipe->block[i]);
+    }
+    pthread_mutex_destroy(&pipe->lock);
+    pthread_cond_destroy(&pipe->cond);
+    free(pipe);
+    return NULL;
+}
+
+//reader
+
+static void *reader_routine(void *arg) {
+    Pipe *pipe = (Pipe*)arg;
+    unsigned len = 0;
+    do {
+        //wait for a free block
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->stop && pipe->filled - pipe->consumed == PIPE_BLOCK_NUM) {
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+        }
+        int stop = pipe->stop;
+        pthread_mutex_unlock(&pipe->lock);
+        if (stop) {
+            break;
+        }
+        //fill the block; the tail of the last block is zeroed
+        unsigned i = pipe->filled % PIPE_BLOCK_NUM;
+        len = fread(pipe->block[i], sizeof(char),
+                    (pipe->limit < PIPE_BLOCK_SIZE) ? pipe->limit : PIPE_BLOCK_SIZE, pipe->file);
+        memset(pipe->block[i] + len, 0, PIPE_BLOCK_SIZE - len);
+        pipe->limit -= len;
+        //hand the block to the consumer (an empty block marks the end)
+        pthread_mutex_lock(&pipe->lock);
+        pipe->block_len[i] = len;
+        ++pipe->filled;
+        pthread_cond_broadcast(&pipe->cond);
+        pthread_mutex_unlock(&pipe->lock);
+    } while (len > 0);
+    return NULL;
+}
+
+Pipe *pipe_open_reader(FILE *file, unsigned limit) {
+    //the file mustn't be accessed by other threads until the pipe is closed
+    return pipe_create(file, limit, reader_routine);
+}
+
+unsigned pipe_read(Pipe *pipe, unsigned char **data) {
+    //returns the length of the next block (0 at the end); the previous block is released
+    pthread_mutex_lock(&pipe->lock);
+    if (pipe->holding) {
+        ++pipe->consumed;
+        pipe->holding = 0;
+        pthread_cond_broadcast(&pipe->cond);
+    }
+    while (pipe->filled == pipe->consumed) {
+        pthread_cond_wait(&pipe->cond, &pipe->lock);
+    }
+    unsigned i = pipe->consumed % PIPE_BLOCK_NUM;
+    unsigned len = pipe->block_len[i];
+    //the final empty block is never released, so it is returned again
+    pipe->holding = (len > 0);
+    *data = pipe->block[i];
+    pthread_mutex_unlock(&pipe->lock);
+    return len;
+}
+
+//writer
+
+static void *writer_routine(void *arg) {
+    Pipe *pipe = (Pipe*)arg;
+    while (1) {
+        //wait for a filled block, write all of them before stopping
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->stop && pipe->filled == pipe->consumed) {
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+        }
+        if (pipe->filled == pipe->consumed) {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        unsigned i = pipe->consumed % PIPE_BLOCK_NUM;
+        pthread_mutex_unlock(&pipe->lock);
+        fwrite(pipe->block[i], sizeof(char), pipe->block_len[i], pipe->file);
+        //release the block
+        pthread_mutex_lock(&pipe->lock);
+        ++pipe->consumed;
+        pthread_cond_broadcast(&pipe->cond);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    return NULL;
+}
+
+Pipe *pipe_open_writer(FILE *file) {
+    //the file mustn't be accessed by other threads until the pipe is closed
+    return pipe_create(file, 0, writer_routine);
+}
+
+unsigned char *pipe_get_block(Pipe *pipe) {
+    //wait for a free block to fill
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->filled - pipe->consumed == PIPE_BLOCK_NUM) {
+        pthread_cond_wait(&pipe->cond, &pipe->lock);
+    }
+    unsigned char *block = pipe->block[pipe->filled % PIPE_BLOCK_NUM];
+    pthread_mutex_unlock(&pipe->lock);
+    return block;
+}
+
+void pipe_put_block(Pipe *pipe, unsigned len) {
+    //hand the block got by pipe_get_block() to the writer
+    pthread_mutex_lock(&pipe->lock);
+    pipe->block_len[pipe->filled % PIPE_BLOCK_NUM] = len;
+    ++pipe->filled;
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+void pipe_drain(Pipe *pipe) {
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->filled != pipe->consumed) {
+        pthread_cond_wait(&pipe->cond, &pipe->lock);
+    }
+    pthread_mutex_unlock(&pipe->lock);
+}
@@ -0,0 +1,35 @@
+#ifndef IO_PIPELINE_H
+#define IO_PIPELINE_H
+
+#include <stdio.h>
+
+//a ring of large blocks between the coding thread & a reader/writer thread
+
+#define PIPE_BLOCK_SIZE (1u << 18)
+#define PIPE_BLOCK_NUM 4
+
+typedef struct Pipe Pipe;
+
+//reader: a thread reads up to limit bytes of the file ahead of the consumer
+
+Pipe *pipe_open_reader(FILE *file, unsigned limit);
+
+unsigned pipe_read(Pipe *pipe, unsigned char **data);
+
+//writer: a thread writes the filled blocks to the file
+
+Pipe *pipe_open_writer(FILE *file);
+
+unsigned char *pipe_get_block(Pipe *pipe);
+
+void pipe_put_block(Pipe *pipe, unsigned len);
+
+//wait until the put blocks are written (the file may be accessed until the next block is put)
+
+void pipe_drain(Pipe *pipe);
+
+//stop the thread (a writer writes all the put blocks first)
+
+void *pipe_close(Pipe *pipe);
+
+#endif // IO_PIPELINE_H
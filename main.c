@@ -1,77 +1,389 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <libgen.h>
-#include "archiver.h"
-
-void print_info(void) {
-    printf("Info:\n");
-}
-
-void print_usage(char *app_path) {
-    char *app_name = basename(app_path);
-    printf("\n\tUsage:\n\n"
-           ">> %s [-h]: \n\tprint application information;\n\n"
-           ">> %s [-a] archive_file file_1 .. file_n: \n\tadd files to an existing archive (create it otherwise);\n\n"
-           ">> %s [-x] archive_file file_1 .. file_n: \n\textract files from an existing archive;\n\n"
-           ">> %s [-xall] archive_file: \n\textract all files from an existing archive;\n\n"
-           ">> %s [-d] archive_file file_1 .. file_n: \n\tdelete files from an existing archive;\n\n"
-           ">> %s [-dall] archive_file: \n\tdelete all files from an existing archive;\n\n"
-           ">> %s [-l] archive_file: \n\ttest archive integrity;\n\n"
-           ">> %s [-t] archive_file: \n\tprint archive information.\n\n",
-            app_name, app_name, app_name, app_name, app_name,
-            app_name, app_name, app_name);
-}
-
-int main(int argc, char *argv[])
-{
-    //print info
-    if (argc >= 2 && !strcmp(argv[1], "-h")) {
-        print_info();
-        exit(0);
-    }
-    //print usage
-    if (argc <= 2) {
-        print_usage(argv[0]);
-        exit(0);
-    }
-    MenuOption opt = InvalidOption;
-    //add to archive
-    if (!strcmp(argv[1], "-a")) {
-        opt = AddToArchive;
-    }
-    //extract from archive
-    else if (!strcmp(argv[1], "-x")) {
-        opt = ExtractFromArchive;
-    }
-    //extract all files from archive
-    else if (!strcmp(argv[1], "-xall")) {
-        opt = ExtractAll;
-    }
-    //remove from archive
-    else if (!strcmp(argv[1], "-d")) {
-        opt = RemoveFromArchive;
-    }
-    //remove all files from archive
-    else if (!strcmp(argv[1], "-dall")) {
-        opt = RemoveFromArchive;
-    }
-    //check archive's integrity
-    else if (!strcmp(argv[1], "-t")) {
-        opt = CheckIntegrity;
-    }
-    //print archive's info
-    else if (!strcmp(argv[1], "-l")) {
-        opt = PrintInfo;
-    }
-
-    if (opt == InvalidOption) {
-        //print usage
-        print_usage(argv[0]);
-    }
-    else {
-        choice_menu(argv[2], argv + 3, argc - 3, opt);
-    }
-
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "archiver.h"
+#include "stats.h"
+
+//progress of the operation & its deadline
+
+typedef struct ProgressState {
+    int print;
+    double deadline;
+} ProgressState;
+
+int report_progress(unsigned long long bytes_done, unsigned long long bytes_total, void *arg) {
+    ProgressState *state = (ProgressState*)arg;
+    if (state->print && bytes_total > 0) {
+        fprintf(stderr, "\t%3llu%% (%llu of %llu bytes)\n",
+                (bytes_done < bytes_total ? bytes_done : bytes_total) * 100 / bytes_total, bytes_done, bytes_total);
+    }
+    else if (state->print) {
+        fprintf(stderr, "\t%llu bytes\n", bytes_done);
+    }
+    if (state->deadline > 0 && stats_now() > state->deadline) {
+        fprintf(stderr, "\tThe time limit is exceeded!\n");
+        return 1;
+    }
+    return 0;
+}
+
+//file lists: @listfile or --files-from listfile ("-" is stdin)
+//names are separated by NUL characters, or by line breaks if the list has no NUL characters
+
+typedef struct NameList {
+    char **names;
+    unsigned num;
+    unsigned capacity;
+} NameList;
+
+void name_list_add(NameList *list, char *name) {
+    if (list->num == list->capacity) {
+        list->capacity = (list->capacity > 0) ? 2 * list->capacity : 64;
+        list->names = (char**)realloc(list->names, list->capacity * sizeof(char*));
+    }
+    list->names[list->num++] = name;
+}
+
+char *read_whole_file(const char *file_name, size_t *size_out) {
+    //returns NULL if the file can't be read ("-" is stdin); the contents are terminated by a NUL character
+    FILE *file = strcmp(file_name, "-") ? fopen(file_name, "rb") : stdin;
+    if (file == NULL) {
+        return NULL;
+    }
+    size_t size = 0, capacity = 1 << 16, len = 0;
+    char *data = (char*)malloc(capacity + 1);
+    while ((len = fread(data + size, sizeof(char), capacity - size, file)) > 0) {
+        size += len;
+        if (size == capacity) {
+            capacity *= 2;
+            data = (char*)realloc(data, capacity + 1);
+        }
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    data[size] = '\0';
+    *size_out = size;
+    return data;
+}
+
+int read_name_list(NameList *list, const char *list_name) {
+    //returns 0 if the list can't be read; the names point into the list's contents, which are kept
+    size_t size = 0;
+    char *data = read_whole_file(list_name, &size);
+    if (data == NULL) {
+        return 0;
+    }
+    char separator = (memchr(data, '\0', size) != NULL) ? '\0' : '\n';
+    for (char *name = data, *end = data + size; name < end; ) {
+        char *next = memchr(name, separator, end - name);
+        next = (next != NULL) ? next : end;
+        *next = '\0';
+        if (separator == '\n' && next > name && next[-1] == '\r') {
+            next[-1] = '\0';
+        }
+        if (*name) {
+            name_list_add(list, name);
+        }
+        name = next + 1;
+    }
+    return 1;
+}
+
+MenuOption parse_operation(const char *arg) {
+    //add to archive
+    if (!strcmp(arg, "-a")) {
+        return AddToArchive;
+    }
+    //update files in archive
+    if (!strcmp(arg, "-u")) {
+        return UpdateArchive;
+    }
+    if (!strcmp(arg, "-uh")) {
+        return UpdateByContents;
+    }
+    //extract from archive
+    if (!strcmp(arg, "-x")) {
+        return ExtractFromArchive;
+    }
+    //extract all files from archive
+    if (!strcmp(arg, "-xall")) {
+        return ExtractAll;
+    }
+    //remove from archive
+    if (!strcmp(arg, "-d")) {
+        return RemoveFromArchive;
+    }
+    //remove all files from archive
+    if (!strcmp(arg, "-dall")) {
+        return RemoveAll;
+    }
+    //check archive's integrity
+    if (!strcmp(arg, "-t")) {
+        return CheckIntegrity;
+    }
+    //print archive's info
+    if (!strcmp(arg, "-l")) {
+        return PrintInfo;
+    }
+    //decode files to stdout
+    if (!strcmp(arg, "-c")) {
+        return CatMembers;
+    }
+    return InvalidOption;
+}
+
+//batch scripts: a command per line, the operation followed by file names (or @listfile) as in the command line;
+//names with spaces are quoted, empty lines & lines beginning with # are skipped
+
+typedef struct CommandList {
+    BatchCommand *commands;
+    unsigned num;
+    unsigned capacity;
+} CommandList;
+
+char *next_token(char **pos) {
+    //returns NULL at the end of the line; the token is terminated in place
+    char *p = *pos;
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        ++p;
+    }
+    if (*p == '\0') {
+        *pos = p;
+        return NULL;
+    }
+    char *token = p;
+    if (*p == '"') {
+        token = ++p;
+        while (*p != '\0' && *p != '"') {
+            ++p;
+        }
+    }
+    else {
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r') {
+            ++p;
+        }
+    }
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+    *pos = p;
+    return token;
+}
+
+int read_batch(CommandList *list, const char *script_name) {
+    //returns 0 if the script can't be read or has an invalid command (the error is printed)
+    size_t size = 0;
+    char *data = read_whole_file(script_name, &size);
+    if (data == NULL) {
+        fprintf(stderr, "\tFailed to read the batch script <<%s>>!\n", script_name);
+        return 0;
+    }
+    unsigned line_num = 0;
+    for (char *line = data, *end = data + size, *next = NULL; line < end; line = next + 1) {
+        next = memchr(line, '\n', end - line);
+        next = (next != NULL) ? next : end;
+        *next = '\0';
+        ++line_num;
+        char *pos = line;
+        char *token = next_token(&pos);
+        if (token == NULL || token[0] == '#') {
+            continue;
+        }
+        MenuOption opt = parse_operation(token);
+        if (opt == InvalidOption) {
+            fprintf(stderr, "\t<<%s>>, line %u: invalid command <<%s>>!\n", script_name, line_num, token);
+            return 0;
+        }
+        NameList names = {0};
+        while ((token = next_token(&pos)) != NULL) {
+            if (token[0] != '@') {
+                name_list_add(&names, token);
+            }
+            else if (!read_name_list(&names, token + 1)) {
+                fprintf(stderr, "\tFailed to read the file list <<%s>>!\n", token + 1);
+                free(names.names);
+                return 0;
+            }
+        }
+        if (list->num == list->capacity) {
+            list->capacity = (list->capacity > 0) ? 2 * list->capacity : 16;
+            list->commands = (BatchCommand*)realloc(list->commands, list->capacity * sizeof(BatchCommand));
+        }
+        BatchCommand command = {opt, names.names, names.num};
+        list->commands[list->num++] = command;
+    }
+    return 1;
+}
+
+void free_batch(CommandList *list) {
+    for (unsigned i = 0; i < list->num; ++i) {
+        free(list->commands[i].file_names);
+    }
+    free(list->commands);
+}
+
+int is_level(const char *arg) {
+    //-1 .. -9
+    return arg[0] == '-' && arg[1] >= '1' && arg[1] <= '9' && arg[2] == '\0';
+}
+
+void print_info(void) {
+    printf("Info:\n");
+}
+
+void print_usage(char *app_path) {
+    char *app_name = basename(app_path);
+    printf("\n\tUsage:\n\n"
+           ">> %s [-h]: \n\tprint application information;\n\n"
+           ">> %s [-a] archive_file file_1 .. file_n: \n\tadd files to an existing archive (create it otherwise);\n\tdirectories are added with all the files below them;\n\tthe names are stored without a leading / & everything up to the last .. (as tar does);\n\n"
+           ">> %s [-u] archive_file file_1 .. file_n: \n\tadd new files & recompress files changed since they were added\n\t(compares sizes & modification times);\n\n"
+           ">> %s [-uh] archive_file file_1 .. file_n: \n\tthe same as -u, but compares sizes & contents;\n\n"
+           ">> %s [-x] archive_file file_1 .. file_n: \n\textract files from an existing archive;\n\n"
+           ">> %s [-xall] archive_file: \n\textract all files from an existing archive;\n\n"
+           ">> %s [-c] archive_file file_1 .. file_n: \n\twrite files from an existing archive to stdout one after another\n\t(messages go to stderr);\n\n"
+           ">> %s [-d] archive_file file_1 .. file_n: \n\tdelete files from an existing archive;\n\n"
+           ">> %s [-dall] archive_file: \n\tdelete all files from an existing archive;\n\n"
+           ">> %s [-l] archive_file: \n\ttest archive integrity;\n\n"
+           ">> %s [-t] archive_file: \n\tprint archive information;\n\n"
+           ">> %s [-e] file_1 .. file_n: \n\testimate the compressed sizes of files & the size of their archive\n"
+           "\t(static coding; only the symbol counts are taken, nothing is written);\n\n"
+           ">> %s --batch script archive_file: \n\trun the operations of script on the archive opened once, an operation per line\n"
+           "\t(e.g. -a file_1 \"file 2\"; lines beginning with # are skipped); listing, extraction & checking\n"
+           "\tsee the changes of the lines before, which are written in one rewrite of the archive at the end.\n\n"
+           "\tOptions (placed before the operation):\n\n"
+           "--adaptive: \n\tcode added files in one pass, adapting the code to the data read so far\n"
+           "\t(always used for pipes & other inputs that can't be rewound);\n\n"
+           "-1 .. -9: \n\tcompression level of added files (6 by default): 1-5 take the code from a sample\n"
+           "\tof 1/32 .. 1/2 of a large file (faster), 7-9 code by the byte before every byte where it's smaller\n"
+           "\t(slower; for text), with up to 4, 8 & 16 code trees for such contexts;\n"
+           "\t-e estimates levels 1-5 as 6;\n\n"
+           "--order1: \n\tthe same as -9;\n\n"
+           "--stats, --stats=json: \n\tprint the time, bytes read & written and MB/s of every phase\n"
+           "\t(analyze, tree, encode, decode, copy, checksum, directory) & every member at exit;\n\n"
+           "--trace=file: \n\twrite the timeline of the operation's members & phases on every thread to file\n"
+           "\t(Chrome trace JSON, for chrome://tracing or Perfetto);\n\n"
+           "--progress: \n\tprint the progress of the coding every MB;\n\n"
+           "--timeout=seconds: \n\tcancel the operation when it takes longer (the archive stays consistent);\n\n"
+           "--uring: \n\textract small files in batches through io_uring (Linux) rather than one by one\n"
+           "\t(faster only where the kernel's workers run beside the decoding, on several cores);\n\n"
+           "--files-from listfile, @listfile (in place of a file name): \n\ttake the file names from listfile (- is stdin),\n"
+           "\tseparated by NUL characters or, if there are none, by line breaks;\n"
+           "\tall the files are processed in one archive update.\n\n",
+            app_name, app_name, app_name, app_name, app_name,
+            app_name, app_name, app_name, app_name, app_name, app_name, app_name, app_name);
+}
+
+int main(int argc, char *argv[])
+{
+    //parse options preceding the operation
+    ArchiverOptions options = {0};
+    ProgressState progress = {0};
+    const char *files_from = NULL, *batch_script = NULL;
+    int opt_num = 0;
+    for (; opt_num + 1 < argc && (!strncmp(argv[opt_num + 1], "--", 2) || is_level(argv[opt_num + 1])); ++opt_num) {
+        if (is_level(argv[opt_num + 1])) {
+            options.level = argv[opt_num + 1][1] - '0';
+        }
+        else if (!strcmp(argv[opt_num + 1], "--adaptive")) {
+            options.adaptive = 1;
+        }
+        else if (!strcmp(argv[opt_num + 1], "--order1")) {
+            options.level = 9;
+        }
+        else if (!strcmp(argv[opt_num + 1], "--stats")) {
+            options.stats = StatsTable;
+        }
+        else if (!strcmp(argv[opt_num + 1], "--stats=json")) {
+            options.stats = StatsJson;
+        }
+        else if (!strncmp(argv[opt_num + 1], "--trace=", 8)) {
+            options.trace_file = argv[opt_num + 1] + 8;
+        }
+        else if (!strcmp(argv[opt_num + 1], "--progress")) {
+            progress.print = 1;
+            options.progress = report_progress;
+        }
+        else if (!strncmp(argv[opt_num + 1], "--timeout=", 10)) {
+            progress.deadline = stats_now() + atof(argv[opt_num + 1] + 10);
+            options.progress = report_progress;
+        }
+        else if (!strcmp(argv[opt_num + 1], "--uring")) {
+            options.uring = 1;
+        }
+        else if (!strncmp(argv[opt_num + 1], "--files-from=", 13)) {
+            files_from = argv[opt_num + 1] + 13;
+        }
+        else if (!strcmp(argv[opt_num + 1], "--files-from") && opt_num + 2 < argc) {
+            files_from = argv[opt_num + 2];
+            ++opt_num;
+        }
+        else if (!strcmp(argv[opt_num + 1], "--batch") && opt_num + 2 < argc) {
+            batch_script = argv[opt_num + 2];
+            ++opt_num;
+        }
+        else {
+            print_usage(argv[0]);
+            exit(0);
+        }
+    }
+    options.progress_arg = &progress;
+    //drop the options, keeping the application path
+    argv[opt_num] = argv[0];
+    argv += opt_num;
+    argc -= opt_num;
+    //print info
+    if (argc >= 2 && !strcmp(argv[1], "-h")) {
+        print_info();
+        exit(0);
+    }
+    //run a batch script on the archive
+    if (batch_script != NULL && argc == 2) {
+        CommandList batch = {0};
+        if (!read_batch(&batch, batch_script)) {
+            exit(1);
+        }
+        batch_menu(argv[1], batch.commands, batch.num, &options);
+        free_batch(&batch);
+        exit(0);
+    }
+    //print usage
+    if (argc <= 2 || batch_script != NULL) {
+        print_usage(argv[0]);
+        exit(0);
+    }
+    //expand the file lists, which follow the archive name (or the operation for -e)
+    int names_beg = strcmp(argv[1], "-e") ? 3 : 2;
+    NameList list = {0};
+    for (int i = names_beg; i < argc; ++i) {
+        if (argv[i][0] != '@') {
+            name_list_add(&list, argv[i]);
+        }
+        else if (!read_name_list(&list, argv[i] + 1)) {
+            fprintf(stderr, "\tFailed to read the file list <<%s>>!\n", argv[i] + 1);
+            exit(1);
+        }
+    }
+    if (files_from != NULL && !read_name_list(&list, files_from)) {
+        fprintf(stderr, "\tFailed to read the file list <<%s>>!\n", files_from);
+        exit(1);
+    }
+    //estimate compression
+    if (!strcmp(argv[1], "-e")) {
+        estimate_menu(list.names, list.num, &options);
+        free(list.names);
+        exit(0);
+    }
+    MenuOption opt = parse_operation(argv[1]);
+    if (opt == InvalidOption) {
+        //print usage
+        print_usage(argv[0]);
+    }
+    else {
+        choice_menu(argv[2], list.names, list.num, opt, &options);
+    }
+    free(list.names);
+
+    return 0;
+}
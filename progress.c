@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "progress.h"
+
+static ProgressCallback progress_callback = NULL;
+static void *progress_arg = NULL;
+static unsigned long long progress_total = 0;
+static atomic_ullong progress_done = 0;
+static atomic_ullong next_report = 0;
+static atomic_int cancelled = 0;
+//the state put aside by progress_suspend()
+static ProgressCallback suspended_callback = NULL;
+static int suspended_cancelled = 0;
+
+void progress_start(ProgressCallback callback, void *arg, unsigned long long bytes_total) {
+    progress_arg = arg;
+    progress_total = bytes_total;
+    atomic_store(&progress_done, 0);
+    atomic_store(&next_report, PROGRESS_INTERVAL);
+    atomic_store(&cancelled, 0);
+    progress_callback = callback;
+}
+
+void progress_stop(void) {
+    progress_callback = NULL;
+}
+
+int progress_add(unsigned bytes) {
+    if (progress_callback == NULL) {
+        return 0;
+    }
+    unsigned long long done = atomic_fetch_add(&progress_done, bytes) + bytes;
+    unsigned long long report = atomic_load(&next_report);
+    //only the thread that moves the report point invokes the callback
+    if (done >= report && atomic_compare_exchange_strong(&next_report, &report, done + PROGRESS_INTERVAL)) {
+        if (progress_callback(done, progress_total, progress_arg)) {
+            atomic_store(&cancelled, 1);
+        }
+    }
+    return atomic_load_explicit(&cancelled, memory_order_relaxed);
+}
+
+int progress_cancelled(void) {
+    return atomic_load(&cancelled);
+}
+
+void progress_suspend(void) {
+    suspended_callback = progress_callback;
+    suspended_cancelled = atomic_load(&cancelled);
+    progress_callback = NULL;
+    atomic_store(&cancelled, 0);
+}
+
+void progress_resume(void) {
+    atomic_store(&cancelled, suspended_cancelled);
+    progress_callback = suspended_callback;
+}
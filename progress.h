@@ -0,0 +1,30 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+//progress reporting & cancellation of the coding
+//the callback is invoked from the input buffer's refills (of any coding thread) every PROGRESS_INTERVAL bytes
+//with the bytes read by the coder so far & the expected total (0 if unknown);
+//a nonzero return cancels the coding: the input looks exhausted from then on & the coding loops stop
+
+#define PROGRESS_INTERVAL (1u << 20)
+
+typedef int (*ProgressCallback)(unsigned long long bytes_done, unsigned long long bytes_total, void *arg);
+
+void progress_start(ProgressCallback callback, void *arg, unsigned long long bytes_total);
+
+void progress_stop(void);
+
+//count the bytes read; returns nonzero if the coding is cancelled
+
+int progress_add(unsigned bytes);
+
+int progress_cancelled(void);
+
+//the coding of the archive's own data (its directory) is neither reported nor cancelled:
+//the progress of the operation is put aside until it's resumed
+
+void progress_suspend(void);
+
+void progress_resume(void);
+
+#endif // PROGRESS_H
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+
+typedef struct StatRecord {
+    char *name;
+    double seconds;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    unsigned long long count;
+} StatRecord;
+
+static const char *phase_names[PhaseNum] = {
+    "analyze", "tree", "encode", "decode", "copy", "checksum", "directory"
+};
+
+static int enabled = 0;
+static _Thread_local int suspended = 0;
+static double start_time = 0;
+static StatRecord phases[PhaseNum];
+static StatRecord *members = NULL;
+static unsigned member_num = 0, member_cap = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void stats_enable(int enable) {
+    enabled = enable;
+    start_time = stats_now();
+}
+
+int stats_enabled(void) {
+    return enabled;
+}
+
+void stats_suspend(void) {
+    ++suspended;
+}
+
+void stats_resume(void) {
+    --suspended;
+}
+
+double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//add intervals
+
+void stats_add_phase(StatPhase phase, double beg, unsigned long long bytes_read,
+                     unsigned long long bytes_written) {
+    if (!enabled || suspended > 0) {
+        return;
+    }
+    double seconds = stats_now() - beg;
+    pthread_mutex_lock(&stats_lock);
+    phases[phase].seconds += seconds;
+    phases[phase].bytes_read += bytes_read;
+    phases[phase].bytes_written += bytes_written;
+    ++phases[phase].count;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_add_member(const char *name, double beg, unsigned long long bytes_read,
+                      unsigned long long bytes_written) {
+    if (!enabled) {
+        return;
+    }
+    double seconds = stats_now() - beg;
+    pthread_mutex_lock(&stats_lock);
+    if (member_num == member_cap) {
+        member_cap = (member_cap > 0) ? 2 * member_cap : 64;
+        members = (StatRecord*)realloc(members, member_cap * sizeof(StatRecord));
+    }
+    StatRecord record = {strdup(name), seconds, bytes_read, bytes_written, 1};
+    members[member_num++] = record;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+//print
+
+static double mb_per_s(const StatRecord *record) {
+    //throughput of the larger side
+    unsigned long long bytes = (record->bytes_read > record->bytes_written) ?
+                               record->bytes_read : record->bytes_written;
+    return (record->seconds > 0) ? bytes / 1048576.0 / record->seconds : 0;
+}
+
+void print_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', out);
+        }
+        if ((unsigned char)*str < 0x20) {
+            fprintf(out, "\\u%04x", *str);
+        }
+        else {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void print_json_record(FILE *out, const char *name, const StatRecord *record) {
+    fprintf(out, "{\"name\":");
+    print_json_string(out, name);
+    fprintf(out, ",\"seconds\":%.6f,\"bytes_read\":%llu,\"bytes_written\":%llu,\"count\":%llu,\"mb_s\":%.3f}",
+            record->seconds, record->bytes_read, record->bytes_written, record->count, mb_per_s(record));
+}
+
+void stats_print(FILE *out, int json) {
+    if (!enabled) {
+        return;
+    }
+    double total = stats_now() - start_time;
+    pthread_mutex_lock(&stats_lock);
+    if (json) {
+        fprintf(out, "{\"total_seconds\":%.6f,\"phases\":[", total);
+        for (unsigned i = 0; i < PhaseNum; ++i) {
+            fprintf(out, (i > 0) ? "," : "");
+            print_json_record(out, phase_names[i], &phases[i]);
+        }
+        fprintf(out, "],\"members\":[");
+        for (unsigned i = 0; i < member_num; ++i) {
+            fprintf(out, (i > 0) ? "," : "");
+            print_json_record(out, members[i].name, &members[i]);
+        }
+        fprintf(out, "]}\n");
+    }
+    else {
+        fprintf(out, "\n\t>>Total: %.3f s\n", total);
+        fprintf(out, "\n\t%-10s %10s %14s %14s %10s\n", "phase", "seconds", "read", "written", "MB/s");
+        for (unsigned i = 0; i < PhaseNum; ++i) {
+            if (phases[i].count > 0) {
+                fprintf(out, "\t%-10s %10.3f %14llu %14llu %10.2f\n", phase_names[i], phases[i].seconds,
+                        phases[i].bytes_read, phases[i].bytes_written, mb_per_s(&phases[i]));
+            }
+        }
+        if (member_num > 0) {
+            fprintf(out, "\n\t%-30s %10s %14s %14s %10s\n", "member", "seconds", "read", "written", "MB/s");
+        }
+        for (unsigned i = 0; i < member_num; ++i) {
+            fprintf(out, "\t%-30s %10.3f %14llu %14llu %10.2f\n", members[i].name, members[i].seconds,
+                    members[i].bytes_read, members[i].bytes_written, mb_per_s(&members[i]));
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,49 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+//per-phase & per-member timing of an operation (--stats)
+
+typedef enum StatPhase {
+    PhaseAnalyze,
+    PhaseTree,
+    PhaseEncode,
+    PhaseDecode,
+    PhaseCopy,
+    PhaseChecksum,
+    //coding & decoding of the archive's directory (the coder's own phases aren't counted in it)
+    PhaseDirectory,
+    PhaseNum
+} StatPhase;
+
+void stats_enable(int enabled);
+
+int stats_enabled(void);
+
+//monotonic time in seconds
+
+double stats_now(void);
+
+//add a measured interval (thread-safe; nothing is recorded unless enabled)
+
+void stats_add_phase(StatPhase phase, double beg, unsigned long long bytes_read,
+                     unsigned long long bytes_written);
+
+void stats_add_member(const char *name, double beg, unsigned long long bytes_read,
+                      unsigned long long bytes_written);
+
+//the intervals of the calling thread aren't recorded until they're resumed
+//(e.g. the coder's phases of a part measured as a whole)
+
+void stats_suspend(void);
+
+void stats_resume(void);
+
+void stats_print(FILE *out, int json);
+
+//a quoted & escaped JSON string (of the --stats=json & --trace output)
+
+void print_json_string(FILE *out, const char *str);
+
+#endif // STATS_H
@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "alloc_count.h"
+
+//the linker redirects the calls to __wrap_*, the originals are __real_*
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *str);
+int __real_posix_memalign(void **ptr, size_t align, size_t size);
+
+static atomic_ulong alloc_num = 0;
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&alloc_num, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+    atomic_fetch_add_explicit(&alloc_num, 1, memory_order_relaxed);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    //a growth is counted as an allocation too
+    atomic_fetch_add_explicit(&alloc_num, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *str) {
+    atomic_fetch_add_explicit(&alloc_num, 1, memory_order_relaxed);
+    return __real_strdup(str);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t align, size_t size) {
+    atomic_fetch_add_explicit(&alloc_num, 1, memory_order_relaxed);
+    return __real_posix_memalign(ptr, align, size);
+}
+
+unsigned long alloc_count(void) {
+    return atomic_load(&alloc_num);
+}
@@ -0,0 +1,9 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+//the number of heap allocations made so far by the code linked with the wrappers (see CMakeLists.txt);
+//the allocations inside the C library (e.g. by fopen()) aren't counted
+
+unsigned long alloc_count(void);
+
+#endif // ALLOC_COUNT_H
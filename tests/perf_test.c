@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "archiver.h"
+#include "file_processing.h"
+#include "huffman_coding.h"
+#include "corpus.h"
+#include "alloc_count.h"
+
+//performance regression test: fixed workloads are timed & their heap allocations are counted,
+//then compared with the baselines recorded in a JSON lines file (one line per workload)
+//a workload fails if its median MB/s falls below (1 - tolerance) of the baseline or it allocates more than the baseline
+//(with a slack of 1/8 for the allocations made by the threads)
+
+#define WARMUP_NUM 1
+#define REPEAT_NUM 7
+//the baselines are the medians of more runs
+#define RECORD_REPEAT_NUM (3 * REPEAT_NUM)
+//above the pipelining threshold, so the reader & writer threads are a part of the workloads
+#define INPUT_SIZE (4u << 20)
+#define CRC_INPUT_SIZE (16u << 20)
+#define DEFAULT_TOLERANCE 0.2
+
+//inputs
+
+static unsigned char *random_input = NULL;
+static FILE *text_file = NULL;
+static FILE *encoded_file = NULL;
+static FILE *context_file = NULL;
+static unsigned char *encoded_data = NULL;
+static unsigned encoded_size = 0;
+static unsigned char *context_data = NULL;
+static unsigned context_size = 0;
+static CodingMethod context_method = StaticCoding;
+//the archive of the rewrite workload & its copy rewritten by every run
+static char arch_dir[] = "/tmp/huffman_perf_XXXXXX";
+static char arch_copy[] = "copy.huf";
+static unsigned arch_size = 0;
+
+static unsigned char *read_temp_file(FILE *file, unsigned *size) {
+    *size = get_file_size(file);
+    unsigned char *data = (unsigned char*)malloc(*size + 1);
+    rewind(file);
+    *size = fread(data, sizeof(char), *size, file);
+    return data;
+}
+
+static int make_inputs(void) {
+    //returns 0 if the temporary files can't be created
+    random_input = make_dataset(RandomData, CRC_INPUT_SIZE);
+    unsigned char *text = make_dataset(TextData, INPUT_SIZE);
+    text_file = make_temp_file(text, INPUT_SIZE);
+    encoded_file = tmpfile();
+    context_file = tmpfile();
+    if (text_file == NULL || encoded_file == NULL || context_file == NULL ||
+        mkdtemp(arch_dir) == NULL || chdir(arch_dir) != 0) {
+        free(text);
+        return 0;
+    }
+    encode_file(text_file, encoded_file);
+    encoded_data = read_temp_file(encoded_file, &encoded_size);
+    rewind(text_file);
+    analyze_file_contexts(text_file);
+    context_method = encode_analyzed_file_contexts(text_file, context_file, 16);
+    context_data = read_temp_file(context_file, &context_size);
+    //an archive of the text & the binary data
+    FILE *file = fopen("text.dat", "wb");
+    fwrite(text, sizeof(char), INPUT_SIZE, file);
+    fclose(file);
+    free(text);
+    unsigned char *binary = make_dataset(BinaryData, INPUT_SIZE);
+    file = fopen("binary.dat", "wb");
+    fwrite(binary, sizeof(char), INPUT_SIZE, file);
+    fclose(file);
+    free(binary);
+    char *names[] = {"text.dat", "binary.dat"};
+    ArchiverOptions options = {0};
+    choice_menu("perf.huf", names, 2, AddToArchive, &options);
+    FILE *arch = fopen("perf.huf", "rb");
+    arch_size = (arch != NULL) ? get_file_size(arch) : 0;
+    file_close(arch);
+    return arch_size > 0;
+}
+
+static void free_inputs(void) {
+    remove("text.dat");
+    remove("binary.dat");
+    remove("perf.huf");
+    remove(arch_copy);
+    if (chdir("/") == 0) {
+        rmdir(arch_dir);
+    }
+    file_close(text_file);
+    file_close(encoded_file);
+    file_close(context_file);
+    free(random_input);
+    free(encoded_data);
+    free(context_data);
+}
+
+//workloads
+
+static volatile uint32_t sink = 0;
+
+static void prepare_none(void) {
+}
+
+static void run_crc32(void) {
+    uint32_t crc = 0;
+    crc32(random_input, CRC_INPUT_SIZE, &crc);
+    sink = crc;
+}
+
+static void prepare_encode(void) {
+    rewind(text_file);
+    rewind(encoded_file);
+}
+
+static void run_analyze(void) {
+    analyze_file(text_file);
+}
+
+static void run_encode(void) {
+    encode_file(text_file, encoded_file);
+}
+
+static void run_encode_contexts(void) {
+    analyze_file_contexts(text_file);
+    encode_analyzed_file_contexts(text_file, encoded_file, 16);
+}
+
+static void run_decode(void) {
+    //the encoded text is decoded to a null sink
+    rewind(encoded_file);
+    sink = decode_file(encoded_file, NULL, INPUT_SIZE, encoded_size);
+}
+
+static void run_decode_memory(void) {
+    sink = decode_memory(encoded_data, NULL, INPUT_SIZE, encoded_size, StaticCoding);
+}
+
+static void run_decode_contexts(void) {
+    sink = decode_memory(context_data, NULL, INPUT_SIZE, context_size, context_method);
+}
+
+static void prepare_rewrite(void) {
+    //a fresh copy of the archive
+    FILE *from = fopen("perf.huf", "rb");
+    FILE *to = fopen(arch_copy, "wb");
+    if (from != NULL && to != NULL) {
+        concat_files(to, from);
+    }
+    file_close(from);
+    file_close(to);
+}
+
+static void run_rewrite(void) {
+    //the text is deleted, so the rest of the archive is copied
+    char *names[] = {"text.dat"};
+    ArchiverOptions options = {0};
+    choice_menu(arch_copy, names, 1, RemoveFromArchive, &options);
+}
+
+typedef struct Workload {
+    const char *name;
+    void (*prepare)(void);
+    void (*run)(void);
+    //bytes processed by a run (the archive size for the rewrite)
+    unsigned bytes;
+} Workload;
+
+static const Workload workloads[] = {
+    {"crc32", prepare_none, run_crc32, CRC_INPUT_SIZE},
+    {"analyze", prepare_encode, run_analyze, INPUT_SIZE},
+    {"encode", prepare_encode, run_encode, INPUT_SIZE},
+    {"encode_contexts", prepare_encode, run_encode_contexts, INPUT_SIZE},
+    {"decode", prepare_none, run_decode, INPUT_SIZE},
+    {"decode_memory", prepare_none, run_decode_memory, INPUT_SIZE},
+    {"decode_contexts", prepare_none, run_decode_contexts, INPUT_SIZE},
+    {"rewrite", prepare_rewrite, run_rewrite, 0}
+};
+
+//timing
+
+typedef struct Measure {
+    double mb_s;
+    unsigned long allocs;
+} Measure;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static Measure measure(const Workload *workload, unsigned repeat_num) {
+    //the median MB/s (a run disturbed by the machine moves it little) & the most allocations of the runs;
+    //the messages of the archiver are dropped
+    Measure result = {0, 0};
+    double mb_s[RECORD_REPEAT_NUM];
+    unsigned bytes = workload->bytes ? workload->bytes : arch_size;
+    fflush(stdout);
+    int stdout_fd = dup(STDOUT_FILENO), null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    for (unsigned i = 0; i < WARMUP_NUM + repeat_num; ++i) {
+        workload->prepare();
+        unsigned long allocs = alloc_count();
+        double beg = now_seconds();
+        workload->run();
+        double seconds = now_seconds() - beg;
+        allocs = alloc_count() - allocs;
+        if (i >= WARMUP_NUM) {
+            mb_s[i - WARMUP_NUM] = bytes / 1048576.0 / seconds;
+        }
+        if (i >= WARMUP_NUM && allocs > result.allocs) {
+            result.allocs = allocs;
+        }
+    }
+    fflush(stdout);
+    dup2(stdout_fd, STDOUT_FILENO);
+    close(stdout_fd);
+    close(null_fd);
+    qsort(mb_s, repeat_num, sizeof(double), cmp_doubles);
+    result.mb_s = mb_s[repeat_num / 2];
+    return result;
+}
+
+//baselines
+
+static int find_baseline(const char *baselines, const char *name, Measure *baseline) {
+    //returns 0 if the workload has no baseline
+    char key[64];
+    snprintf(key, sizeof(key), "{\"workload\":\"%s\",", name);
+    const char *line = strstr(baselines, key);
+    if (line == NULL) {
+        return 0;
+    }
+    const char *mb_s = strstr(line, "\"mb_s\":");
+    const char *allocs = strstr(line, "\"allocs\":");
+    const char *end = strchr(line, '\n');
+    if (mb_s == NULL || allocs == NULL || (end != NULL && (mb_s > end || allocs > end))) {
+        return 0;
+    }
+    baseline->mb_s = atof(mb_s + 7);
+    baseline->allocs = strtoul(allocs + 9, NULL, 10);
+    return 1;
+}
+
+static char *read_baselines(const char *file_name) {
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    unsigned size = get_file_size(file);
+    char *data = (char*)malloc(size + 1);
+    data[fread(data, sizeof(char), size, file)] = '\0';
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s baselines_file [--record] [--tolerance=fraction] [--allocs-only] [workload]\n"
+                        "\t--record writes the measured values to baselines_file;\n"
+                        "\t--allocs-only checks the allocations only (e.g. in a debug build).\n", argv[0]);
+        return 1;
+    }
+    const char *baselines_name = argv[1], *filter = NULL;
+    int record = 0, allocs_only = 0;
+    double tolerance = DEFAULT_TOLERANCE;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "--record")) {
+            record = 1;
+        }
+        else if (!strncmp(argv[i], "--tolerance=", 12)) {
+            tolerance = atof(argv[i] + 12);
+        }
+        else if (!strcmp(argv[i], "--allocs-only")) {
+            allocs_only = 1;
+        }
+        else {
+            filter = argv[i];
+        }
+    }
+    char *baselines = record ? NULL : read_baselines(baselines_name);
+    if (!record && baselines == NULL) {
+        fprintf(stderr, "perf_test: failed to read the baselines <<%s>>!\n", baselines_name);
+        return 1;
+    }
+    //the inputs are made in a temporary directory, so the baselines are opened before
+    FILE *out = record ? fopen(baselines_name, "w") : NULL;
+    if ((record && out == NULL) || !make_inputs()) {
+        fprintf(stderr, "perf_test: failed to create the inputs!\n");
+        file_close(out);
+        free_inputs();
+        return 1;
+    }
+    unsigned failed_num = 0;
+    fprintf(stderr, "%-16s %10s %10s %10s %10s\n", "workload", "MB/s", "baseline", "allocs", "baseline");
+    for (unsigned i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) {
+        const Workload *workload = &workloads[i];
+        if (filter != NULL && strcmp(filter, workload->name)) {
+            continue;
+        }
+        Measure result = measure(workload, record ? RECORD_REPEAT_NUM : REPEAT_NUM);
+        if (out != NULL) {
+            fprintf(out, "{\"workload\":\"%s\",\"mb_s\":%.3f,\"allocs\":%lu}\n",
+                    workload->name, result.mb_s, result.allocs);
+            fprintf(stderr, "%-16s %10.2f %10s %10lu %10s\n", workload->name, result.mb_s, "-", result.allocs, "-");
+            continue;
+        }
+        Measure baseline = {0, 0};
+        if (!find_baseline(baselines, workload->name, &baseline)) {
+            fprintf(stderr, "%-16s %10.2f %10s %10lu %10s  NO BASELINE\n",
+                    workload->name, result.mb_s, "-", result.allocs, "-");
+            ++failed_num;
+            continue;
+        }
+        int slow = !allocs_only && result.mb_s < baseline.mb_s * (1.0 - tolerance);
+        int allocating = result.allocs > baseline.allocs + baseline.allocs / 8;
+        fprintf(stderr, "%-16s %10.2f %10.2f %10lu %10lu%s%s\n", workload->name, result.mb_s, baseline.mb_s,
+                result.allocs, baseline.allocs, slow ? "  SLOWER" : "", allocating ? "  MORE ALLOCATIONS" : "");
+        failed_num += (slow || allocating);
+    }
+    file_close(out);
+    free(baselines);
+    free_inputs();
+    if (failed_num > 0) {
+        fprintf(stderr, "%u workloads regressed\n", failed_num);
+        return 1;
+    }
+    return 0;
+}
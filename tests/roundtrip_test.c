@@ -0,0 +1,493 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "archiver.h"
+#include "file_processing.h"
+#include "huffman_coding.h"
+#include "uring_writer.h"
+#include "corpus.h"
+
+//round trips of every coding method over the test corpus: the decoded data must match bit for bit
+//& the checksums must match the data; then whole archives are written, changed & extracted
+
+//below & above the pipelining threshold (1 MB), so both the direct & the pipelined paths are checked
+static const unsigned sizes[] = {0, 1, 3000, 2u << 20};
+
+static unsigned failed_num = 0;
+
+static void check(int ok, const char *what, Dataset dataset, unsigned size) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s, %s data of %u bytes\n", what, dataset_name(dataset), size);
+        ++failed_num;
+    }
+}
+
+static unsigned char *read_temp_file(FILE *file, unsigned *size) {
+    *size = get_file_size(file);
+    unsigned char *data = (unsigned char*)malloc(*size + 1);
+    rewind(file);
+    *size = fread(data, sizeof(char), *size, file);
+    return data;
+}
+
+static int same_data(FILE *file, const unsigned char *data, unsigned size) {
+    fflush(file);
+    unsigned file_size = 0;
+    unsigned char *file_data = read_temp_file(file, &file_size);
+    int same = (file_size == size && !memcmp(file_data, data, size));
+    free(file_data);
+    return same;
+}
+
+//coding methods
+
+typedef enum Coder {
+    //analyze_file() & encode_analyzed_file(): StaticCoding or SparseCoding
+    FullAnalysis,
+    //analyze_file_sampled() & encode_analyzed_file()
+    SampledAnalysis,
+    //analyze_file_contexts() & encode_analyzed_file_contexts()
+    ContextAnalysis,
+    //encode_file_adaptive()
+    OnePass,
+    CoderNum
+} Coder;
+
+static const char *coder_names[CoderNum] = {"static", "sampled", "contexts", "adaptive"};
+
+static CodingMethod encode(Coder coder, FILE *in, FILE *out) {
+    switch (coder) {
+        case FullAnalysis:
+            analyze_file(in);
+            encode_analyzed_file(in, out);
+            return (get_zero_run_num() > 0) ? SparseCoding : StaticCoding;
+        case SampledAnalysis:
+            analyze_file_sampled(in, 3);
+            encode_analyzed_file(in, out);
+            return (get_zero_run_num() > 0) ? SparseCoding : StaticCoding;
+        case ContextAnalysis:
+            analyze_file_contexts(in);
+            return encode_analyzed_file_contexts(in, out, 16);
+        default:
+            encode_file_adaptive(in, out);
+            return AdaptiveCoding;
+    }
+}
+
+static uint32_t decode_stream(CodingMethod method, FILE *in, FILE *out, unsigned size, unsigned comp_size) {
+    //the decoders reading a file; SparseCoding is decoded from memory only
+    switch (method) {
+        case StaticCoding:
+            return decode_file(in, out, size, comp_size);
+        case ContextCoding:
+            return decode_file_contexts(in, out, size, comp_size);
+        default:
+            return decode_file_adaptive(in, out, size, comp_size);
+    }
+}
+
+static void test_coder(Coder coder, Dataset dataset, unsigned size) {
+    char what[64];
+    unsigned char *data = make_dataset(dataset, size);
+    uint32_t crc = 0;
+    crc32(data, size, &crc);
+    FILE *in = make_temp_file(data, size);
+    FILE *encoded = tmpfile();
+    CodingMethod method = encode(coder, in, encoded);
+    fflush(encoded);
+    snprintf(what, sizeof(what), "%s checksum", coder_names[coder]);
+    check(get_file_crc() == crc, what, dataset, size);
+    //decode from memory (as a mapped archive)
+    unsigned comp_size = 0;
+    unsigned char *comp_data = read_temp_file(encoded, &comp_size);
+    FILE *decoded = tmpfile();
+    snprintf(what, sizeof(what), "%s decode_memory()", coder_names[coder]);
+    check(decode_memory(comp_data, decoded, size, comp_size, method) == crc && same_data(decoded, data, size),
+          what, dataset, size);
+    file_close(decoded);
+    //decode from the file
+    if (method != SparseCoding) {
+        rewind(encoded);
+        decoded = tmpfile();
+        snprintf(what, sizeof(what), "%s decode from a file", coder_names[coder]);
+        check(decode_stream(method, encoded, decoded, size, comp_size) == crc && same_data(decoded, data, size),
+              what, dataset, size);
+        file_close(decoded);
+    }
+    free(comp_data);
+    file_close(encoded);
+    file_close(in);
+    free(data);
+}
+
+//archives
+
+#define ARCH_SIZE (256u << 10)
+
+static int same_file(const char *name, Dataset dataset) {
+    FILE *file = fopen(name, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned char *data = make_dataset(dataset, ARCH_SIZE);
+    int same = same_data(file, data, ARCH_SIZE);
+    free(data);
+    fclose(file);
+    return same;
+}
+
+static void write_corpus(char names[DatasetNum][32], char **name_ptrs) {
+    for (unsigned i = 0; i < DatasetNum; ++i) {
+        snprintf(names[i], 32, "%s.dat", dataset_name(i));
+        name_ptrs[i] = names[i];
+        unsigned char *data = make_dataset(i, ARCH_SIZE);
+        FILE *file = fopen(names[i], "wb");
+        fwrite(data, sizeof(char), ARCH_SIZE, file);
+        fclose(file);
+        free(data);
+    }
+}
+
+static void check_extracted(const char *what, char **name_ptrs) {
+    //the files are removed, extracted & compared
+    for (unsigned i = 0; i < DatasetNum; ++i) {
+        remove(name_ptrs[i]);
+    }
+    ArchiverOptions options = {0};
+    choice_menu("test.huf", NULL, 0, ExtractAll, &options);
+    for (unsigned i = 0; i < DatasetNum; ++i) {
+        check(same_file(name_ptrs[i], i), what, i, ARCH_SIZE);
+    }
+}
+
+static void test_archives(void) {
+    char names[DatasetNum][32];
+    char *name_ptrs[DatasetNum];
+    write_corpus(names, name_ptrs);
+    //sampled, full & order-1 levels, then the one-pass coding (level 0)
+    static const int levels[] = {1, 6, 9, 0};
+    for (unsigned i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+        ArchiverOptions options = {0};
+        options.level = levels[i];
+        options.adaptive = (levels[i] == 0);
+        remove("test.huf");
+        choice_menu("test.huf", name_ptrs, DatasetNum, AddToArchive, &options);
+        char what[64];
+        snprintf(what, sizeof(what), "archive extraction, level %d", levels[i]);
+        check_extracted(what, name_ptrs);
+    }
+    //the rewrite paths: delete, update & a batch, then all the files must be extracted intact
+    ArchiverOptions options = {0};
+    choice_menu("test.huf", &name_ptrs[TextData], 1, RemoveFromArchive, &options);
+    choice_menu("test.huf", name_ptrs, DatasetNum, UpdateByContents, &options);
+    check_extracted("archive extraction after a delete & an update", name_ptrs);
+    BatchCommand commands[] = {
+        {RemoveFromArchive, &name_ptrs[RandomData], 1},
+        {AddToArchive, &name_ptrs[RandomData], 1},
+        {RemoveAll, NULL, 0},
+        {AddToArchive, name_ptrs, DatasetNum},
+        {CheckIntegrity, NULL, 0}
+    };
+    batch_menu("test.huf", commands, sizeof(commands) / sizeof(commands[0]), &options);
+    check_extracted("archive extraction after a batch", name_ptrs);
+    for (unsigned i = 0; i < DatasetNum; ++i) {
+        remove(name_ptrs[i]);
+    }
+    remove("test.huf");
+}
+
+//duplicates: the data of a file with the contents of a stored one is shared after a check byte by byte
+
+static unsigned archive_size(const char *name) {
+    struct stat file_stat;
+    return (stat(name, &file_stat) == 0) ? (unsigned)file_stat.st_size : 0;
+}
+
+static void test_duplicates(void) {
+    unsigned char *data = make_dataset(TextData, ARCH_SIZE);
+    char *names[] = {"dup_a.dat", "dup_b.dat"};
+    for (unsigned i = 0; i < 2; ++i) {
+        FILE *file = fopen(names[i], "wb");
+        fwrite(data, sizeof(char), ARCH_SIZE, file);
+        fclose(file);
+    }
+    ArchiverOptions options = {0};
+    choice_menu("single.huf", names, 1, AddToArchive, &options);
+    choice_menu("dup.huf", names, 2, AddToArchive, &options);
+    //the second copy takes an entry only
+    check(archive_size("dup.huf") < archive_size("single.huf") + 1024, "deduplication", TextData, ARCH_SIZE);
+    //the stored copies are up to date, so the archive isn't rewritten
+    unsigned size = archive_size("dup.huf");
+    choice_menu("dup.huf", names, 2, UpdateByContents, &options);
+    check(archive_size("dup.huf") == size, "update of duplicates by contents", TextData, ARCH_SIZE);
+    for (unsigned i = 0; i < 2; ++i) {
+        remove(names[i]);
+    }
+    choice_menu("dup.huf", NULL, 0, ExtractAll, &options);
+    for (unsigned i = 0; i < 2; ++i) {
+        check(same_file(names[i], TextData), "extraction of duplicates", TextData, ARCH_SIZE);
+        remove(names[i]);
+    }
+    remove("single.huf");
+    remove("dup.huf");
+    free(data);
+}
+
+//files of the tests
+
+static void write_data_file(const char *name, const unsigned char *data, unsigned size) {
+    FILE *file = fopen(name, "wb");
+    fwrite(data, sizeof(char), size, file);
+    fclose(file);
+}
+
+//a member with ".." in its path isn't extracted out of the directory
+
+static void test_unsafe_paths(void) {
+    FILE *file = fopen("outside.dat", "wb");
+    fputs("outside", file);
+    fclose(file);
+    mkdir("inner", 0755);
+    if (chdir("inner") != 0) {
+        check(0, "unsafe path: the directory can't be entered", TextData, 0);
+        return;
+    }
+    char *names[] = {"../outside.dat"};
+    ArchiverOptions options = {0};
+    choice_menu("unsafe.huf", names, 1, AddToArchive, &options);
+    remove("../outside.dat");
+    choice_menu("unsafe.huf", NULL, 0, ExtractAll, &options);
+    check(access("../outside.dat", F_OK) != 0, "unsafe path refused", TextData, 7);
+    remove("unsafe.huf");
+    if (chdir("..") == 0) {
+        rmdir("inner");
+    }
+}
+
+//an archive of another format version isn't read or changed
+
+#define VERSION_FILEPOS 12
+
+static void test_format_version(void) {
+    FILE *file = fopen("version.dat", "wb");
+    fputs("version", file);
+    fclose(file);
+    char *names[] = {"version.dat"};
+    ArchiverOptions options = {0};
+    choice_menu("version.huf", names, 1, AddToArchive, &options);
+    remove("version.dat");
+    //the next version
+    uint32_t version = 0;
+    file = fopen("version.huf", "rb+");
+    fseek(file, VERSION_FILEPOS, SEEK_SET);
+    fread(&version, sizeof(uint32_t), 1, file);
+    ++version;
+    fseek(file, VERSION_FILEPOS, SEEK_SET);
+    fwrite(&version, sizeof(uint32_t), 1, file);
+    fclose(file);
+    unsigned size = archive_size("version.huf");
+    choice_menu("version.huf", names, 1, RemoveFromArchive, &options);
+    check(archive_size("version.huf") == size, "archive of another version left as it is", TextData, 7);
+    choice_menu("version.huf", NULL, 0, ExtractAll, &options);
+    check(access("version.dat", F_OK) != 0, "archive of another version not extracted", TextData, 7);
+    remove("version.dat");
+    remove("version.huf");
+}
+
+//a directory given by its absolute path is stored by a relative name, so it's extracted below the directory
+
+static void test_absolute_root(void) {
+    unsigned char *data = make_dataset(TextData, ARCH_SIZE);
+    mkdir("absroot", 0755);
+    mkdir("absroot/sub", 0755);
+    write_data_file("absroot/a.dat", data, ARCH_SIZE);
+    write_data_file("absroot/sub/b.dat", data, ARCH_SIZE);
+    char root[PATH_MAX], out[PATH_MAX + 16];
+    if (getcwd(root, sizeof(root) - 16) == NULL) {
+        check(0, "absolute root: the directory is unknown", TextData, 0);
+        free(data);
+        return;
+    }
+    strcat(root, "/absroot");
+    char *names[] = {root};
+    ArchiverOptions options = {0};
+    choice_menu("absroot.huf", names, 1, AddToArchive, &options);
+    mkdir("absout", 0755);
+    if (chdir("absout") == 0) {
+        choice_menu("../absroot.huf", NULL, 0, ExtractAll, &options);
+        if (chdir("..") != 0) {
+            check(0, "absolute root: the directory can't be left", TextData, 0);
+        }
+    }
+    //the name is the path without the leading slash
+    static const char *files[] = {"a.dat", "sub/b.dat"};
+    for (unsigned i = 0; i < 2; ++i) {
+        snprintf(out, sizeof(out), "absout%s/%s", root, files[i]);
+        check(same_file(out, TextData), "absolute root extracted below the directory", TextData, ARCH_SIZE);
+        remove(out);
+        snprintf(out, sizeof(out), "absroot/%s", files[i]);
+        remove(out);
+    }
+    //the directories made by the extraction are removed from the deepest one
+    snprintf(out, sizeof(out), "absout%s/sub", root);
+    for (char *sep = out + strlen(out); sep != NULL; sep = strrchr(out, '/')) {
+        *sep = '\0';
+        rmdir(out);
+    }
+    rmdir("absroot/sub");
+    rmdir("absroot");
+    remove("absroot.huf");
+    free(data);
+}
+
+//small members: extracted in io_uring batches (where io_uring is available) & one by one
+
+static int has_uring(void) {
+    UringWriter *writer = uring_writer_open();
+    uring_writer_close(writer);
+    return writer != NULL;
+}
+
+//more than a batch, in directories to be made
+#define SMALL_NUM 300
+#define SMALL_DIR_NUM 7
+
+static void small_file_name(char *name, unsigned i) {
+    snprintf(name, 64, "small/d%u/s%03u.dat", i % SMALL_DIR_NUM, i);
+}
+
+static int same_small_file(unsigned i, const unsigned char *data) {
+    char name[64];
+    small_file_name(name, i);
+    FILE *file = fopen(name, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    int same = same_data(file, data, i * 13);
+    fclose(file);
+    return same;
+}
+
+static void remove_small_files(char **names) {
+    for (unsigned i = 0; i < SMALL_NUM; ++i) {
+        remove(names[i]);
+    }
+    for (unsigned i = 0; i < SMALL_DIR_NUM; ++i) {
+        char dir[64];
+        snprintf(dir, sizeof(dir), "small/d%u", i);
+        rmdir(dir);
+    }
+    rmdir("small");
+}
+
+static void test_small_members(void) {
+    //every file is a prefix of the same data, of i * 13 bytes
+    unsigned char *data = make_dataset(TextData, SMALL_NUM * 13);
+    char *names[SMALL_NUM];
+    mkdir("small", 0755);
+    for (unsigned i = 0; i < SMALL_NUM; ++i) {
+        names[i] = (char*)malloc(64);
+        small_file_name(names[i], i);
+        if (i < SMALL_DIR_NUM) {
+            char dir[64];
+            snprintf(dir, sizeof(dir), "small/d%u", i);
+            mkdir(dir, 0755);
+        }
+        FILE *file = fopen(names[i], "wb");
+        fwrite(data, sizeof(char), i * 13, file);
+        fclose(file);
+    }
+    ArchiverOptions options = {0};
+    choice_menu("small.huf", names, SMALL_NUM, AddToArchive, &options);
+    for (int uring = 1; uring >= 0; --uring) {
+        remove_small_files(names);
+        options.uring = uring;
+        choice_menu("small.huf", NULL, 0, ExtractAll, &options);
+        for (unsigned i = 0; i < SMALL_NUM; ++i) {
+            check(same_small_file(i, data), uring ? "small member extraction in batches" :
+                                                    "small member extraction one by one", TextData, i * 13);
+        }
+        //the batches are used if they're asked for & io_uring is available
+        check((get_batched_member_num() > 0) == (uring && has_uring()),
+              uring ? "small members written by batches" : "small members written one by one", TextData, 0);
+    }
+    remove_small_files(names);
+    for (unsigned i = 0; i < SMALL_NUM; ++i) {
+        free(names[i]);
+    }
+    remove("small.huf");
+    free(data);
+}
+
+//entries of the same name: the newest one is extracted last, in a batch or not
+
+static void test_duplicate_names(void) {
+    //the first member is small in every version, the second one is too large for a batch at last
+    unsigned char *data = make_dataset(TextData, ARCH_SIZE);
+    char *names[] = {"names/a.dat", "names/b.dat"};
+    static const unsigned version_size[][2] = {{10, 20}, {30, 40}, {50, ARCH_SIZE}};
+    unsigned version_num = sizeof(version_size) / sizeof(version_size[0]);
+    mkdir("names", 0755);
+    ArchiverOptions options = {0};
+    for (unsigned k = 0; k < version_num; ++k) {
+        for (unsigned i = 0; i < 2; ++i) {
+            write_data_file(names[i], data + k, version_size[k][i]);
+        }
+        choice_menu("names.huf", names, 2, AddToArchive, &options);
+    }
+    for (int uring = 1; uring >= 0; --uring) {
+        for (unsigned i = 0; i < 2; ++i) {
+            remove(names[i]);
+        }
+        options.uring = uring;
+        choice_menu("names.huf", NULL, 0, ExtractAll, &options);
+        for (unsigned i = 0; i < 2; ++i) {
+            FILE *file = fopen(names[i], "rb");
+            unsigned size = version_size[version_num - 1][i];
+            check(file != NULL && same_data(file, data + version_num - 1, size),
+                  uring ? "newest entry of a name extracted in batches" : "newest entry of a name extracted one by one",
+                  TextData, size);
+            file_close(file);
+        }
+    }
+    for (unsigned i = 0; i < 2; ++i) {
+        remove(names[i]);
+    }
+    rmdir("names");
+    remove("names.huf");
+    free(data);
+}
+
+int main(void) {
+    for (unsigned coder = 0; coder < CoderNum; ++coder) {
+        for (unsigned dataset = 0; dataset < DatasetNum; ++dataset) {
+            for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+                test_coder(coder, dataset, sizes[i]);
+            }
+        }
+    }
+    //the archives are written in a directory of their own
+    char dir[] = "/tmp/huffman_test_XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        fprintf(stderr, "FAILED: the test directory can't be created\n");
+        return 1;
+    }
+    test_archives();
+    test_duplicates();
+    test_unsafe_paths();
+    test_absolute_root();
+    test_format_version();
+    test_small_members();
+    test_duplicate_names();
+    rmdir(dir);
+    if (failed_num > 0) {
+        fprintf(stderr, "%u checks failed\n", failed_num);
+        return 1;
+    }
+    fprintf(stderr, "all round trips passed\n");
+    return 0;
+}
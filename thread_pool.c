@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "thread_pool.h"
+
+typedef struct Worker {
+    TaskFunc task;
+    void *arg;
+    unsigned task_num;
+    //the next task to take
+    atomic_uint *next_task;
+    unsigned worker_ix;
+} Worker;
+
+unsigned get_worker_num(unsigned task_num) {
+    //one worker per core, but not more than tasks
+    long core_num = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned worker_num = (core_num > 0) ? (unsigned)core_num : 1;
+    return (worker_num < task_num) ? worker_num : task_num;
+}
+
+static void *worker_routine(void *arg) {
+    Worker *worker = (Worker*)arg;
+    unsigned task_ix = 0;
+    //tasks are taken one by one, so long tasks don't hold up the others
+    while ((task_ix = atomic_fetch_add(worker->next_task, 1)) < worker->task_num) {
+        worker->task(task_ix, worker->worker_ix, worker->arg);
+    }
+    return NULL;
+}
+
+void parallel_for(unsigned task_num, TaskFunc task, void *arg) {
+    unsigned worker_num = get_worker_num(task_num);
+    if (worker_num == 0) {
+        return;
+    }
+    atomic_uint next_task = 0;
+    Worker *workers = (Worker*)calloc(worker_num, sizeof(Worker));
+    pthread_t *threads = (pthread_t*)calloc(worker_num, sizeof(pthread_t));
+    for (unsigned i = 0; i < worker_num; ++i) {
+        workers[i].task = task;
+        workers[i].arg = arg;
+        workers[i].task_num = task_num;
+        workers[i].next_task = &next_task;
+        workers[i].worker_ix = i;
+    }
+    //the calling thread is the worker 0
+    unsigned thread_num = 1;
+    for (; thread_num < worker_num; ++thread_num) {
+        if (pthread_create(&threads[thread_num], NULL, worker_routine, &workers[thread_num]) != 0) {
+            break;
+        }
+    }
+    worker_routine(&workers[0]);
+    for (unsigned i = 1; i < thread_num; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(workers);
+}
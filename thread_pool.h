@@ -0,0 +1,12 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+//run task(task_ix, worker_ix, arg) for every task_ix < task_num on all cores
+
+typedef void (*TaskFunc)(unsigned task_ix, unsigned worker_ix, void *arg);
+
+unsigned get_worker_num(unsigned task_num);
+
+void parallel_for(unsigned task_num, TaskFunc task, void *arg);
+
+#endif // THREAD_POOL_H
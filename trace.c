@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "trace.h"
+#include "stats.h"
+
+typedef struct TraceEvent {
+    double ts;
+    const char *name;
+    char *arg;
+    char phase;
+} TraceEvent;
+
+//every thread appends to its own buffer, so recording takes no locks
+typedef struct TraceBuffer {
+    TraceEvent *event;
+    unsigned event_num;
+    unsigned capacity;
+    unsigned tid;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+static FILE *trace_file = NULL;
+static double start_time = 0;
+static _Atomic(TraceBuffer*) buffers = NULL;
+static atomic_uint thread_cnt = 0;
+static _Thread_local TraceBuffer *thread_buffer = NULL;
+
+static double now_us(void) {
+    return stats_now() * 1e6;
+}
+
+int trace_open(const char *file_name) {
+    trace_file = fopen(file_name, "w");
+    start_time = now_us();
+    return trace_file != NULL;
+}
+
+static TraceBuffer *get_buffer(void) {
+    if (thread_buffer == NULL) {
+        //register the buffer of a new thread
+        thread_buffer = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+        thread_buffer->tid = atomic_fetch_add(&thread_cnt, 1) + 1;
+        TraceBuffer *head = atomic_load(&buffers);
+        do {
+            thread_buffer->next = head;
+        } while (!atomic_compare_exchange_weak(&buffers, &head, thread_buffer));
+    }
+    return thread_buffer;
+}
+
+static void add_event(char phase, const char *name, const char *arg) {
+    TraceBuffer *buffer = get_buffer();
+    if (buffer->event_num == buffer->capacity) {
+        buffer->capacity = (buffer->capacity > 0) ? 2 * buffer->capacity : 256;
+        buffer->event = (TraceEvent*)realloc(buffer->event, buffer->capacity * sizeof(TraceEvent));
+    }
+    TraceEvent *event = &buffer->event[buffer->event_num++];
+    event->ts = now_us() - start_time;
+    event->name = name;
+    event->arg = (arg != NULL) ? strdup(arg) : NULL;
+    event->phase = phase;
+}
+
+void trace_begin(const char *name, const char *arg) {
+    if (trace_file != NULL) {
+        add_event('B', name, arg);
+    }
+}
+
+void trace_end(const char *name) {
+    if (trace_file != NULL) {
+        add_event('E', name, NULL);
+    }
+}
+
+//dump
+
+void trace_close(void) {
+    if (trace_file == NULL) {
+        return;
+    }
+    fprintf(trace_file, "{\"traceEvents\":[");
+    int first = 1;
+    TraceBuffer *buffer = atomic_exchange(&buffers, NULL);
+    while (buffer != NULL) {
+        for (unsigned i = 0; i < buffer->event_num; ++i) {
+            TraceEvent *event = &buffer->event[i];
+            fprintf(trace_file, "%s\n{\"name\":\"%s\",\"cat\":\"archiver\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                    first ? "" : ",", event->name, event->phase, event->ts, buffer->tid);
+            if (event->arg != NULL) {
+                fprintf(trace_file, ",\"args\":{\"member\":");
+                print_json_string(trace_file, event->arg);
+                fputc('}', trace_file);
+            }
+            fputc('}', trace_file);
+            free(event->arg);
+            first = 0;
+        }
+        TraceBuffer *next = buffer->next;
+        if (buffer == thread_buffer) {
+            thread_buffer = NULL;
+        }
+        free(buffer->event);
+        free(buffer);
+        buffer = next;
+    }
+    fprintf(trace_file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+}
@@ -0,0 +1,17 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+//begin/end events of archive operations in the Chrome trace format (--trace)
+
+//returns 0 if the trace file can't be created
+int trace_open(const char *file_name);
+
+//an event's name must be a string literal; arg (a member's name) may be NULL
+void trace_begin(const char *name, const char *arg);
+
+void trace_end(const char *name);
+
+//the events of all threads are written out; the threads are supposed to be finished
+void trace_close(void);
+
+#endif // TRACE_H
@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "uring_writer.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#if defined(__linux__) && defined(IORING_FEAT_LINKED_FILE)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+//every file is a chain of linked requests: openat to a registered slot, write from the slot & close of the slot,
+//so the descriptors never leave the kernel
+
+#define FILE_REQUESTS 3
+#define RING_ENTRIES (URING_BATCH_FILES * FILE_REQUESTS)
+
+//user_data of a request: the file's index & the request
+enum {OpenRequest, WriteRequest, CloseRequest};
+
+struct UringWriter {
+    int ring_fd;
+    //submission ring
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqe;
+    size_t sqe_size;
+    //completion ring (the same mapping as the submission ring if the kernel shares them)
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqe;
+    //queued files & requests
+    unsigned file_num;
+    unsigned request_num;
+    //the ring can't be used after a failed io_uring_enter()
+    int failed;
+    unsigned size[URING_BATCH_FILES];
+    int result[URING_BATCH_FILES];
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned opcode, const void *arg, unsigned arg_num) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, arg_num);
+}
+
+static int map_rings(UringWriter *writer, const struct io_uring_params *params) {
+    //returns 0 if the rings can't be mapped
+    writer->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    writer->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params->features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && writer->cq_ring_size > writer->sq_ring_size) {
+        writer->sq_ring_size = writer->cq_ring_size;
+    }
+    writer->sq_ring = mmap(NULL, writer->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           writer->ring_fd, IORING_OFF_SQ_RING);
+    if (writer->sq_ring == MAP_FAILED) {
+        writer->sq_ring = NULL;
+        return 0;
+    }
+    writer->cq_ring = single_mmap ? writer->sq_ring :
+                      mmap(NULL, writer->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           writer->ring_fd, IORING_OFF_CQ_RING);
+    if (writer->cq_ring == MAP_FAILED) {
+        writer->cq_ring = NULL;
+        return 0;
+    }
+    writer->sqe_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    writer->sqe = (struct io_uring_sqe*)mmap(NULL, writer->sqe_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, writer->ring_fd, IORING_OFF_SQES);
+    if (writer->sqe == MAP_FAILED) {
+        writer->sqe = NULL;
+        return 0;
+    }
+    char *sq = (char*)writer->sq_ring, *cq = (char*)writer->cq_ring;
+    writer->sq_tail = (unsigned*)(sq + params->sq_off.tail);
+    writer->sq_mask = (unsigned*)(sq + params->sq_off.ring_mask);
+    writer->sq_array = (unsigned*)(sq + params->sq_off.array);
+    writer->cq_head = (unsigned*)(cq + params->cq_off.head);
+    writer->cq_tail = (unsigned*)(cq + params->cq_off.tail);
+    writer->cq_mask = (unsigned*)(cq + params->cq_off.ring_mask);
+    writer->cqe = (struct io_uring_cqe*)(cq + params->cq_off.cqes);
+    return 1;
+}
+
+UringWriter *uring_writer_open(void) {
+    UringWriter *writer = (UringWriter*)calloc(1, sizeof(UringWriter));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    //the chains after a failed request are submitted anyway
+    params.flags = IORING_SETUP_SUBMIT_ALL;
+    writer->ring_fd = uring_setup(RING_ENTRIES, &params);
+    if (writer->ring_fd < 0) {
+        free(writer);
+        return NULL;
+    }
+    //the write of a chain needs the slot its open fills, so the file must be looked up when the write runs
+    int ok = (params.features & IORING_FEAT_LINKED_FILE) && (params.features & IORING_FEAT_NODROP) &&
+             map_rings(writer, &params);
+    //a slot per file of a batch
+    int slot[URING_BATCH_FILES];
+    for (unsigned i = 0; i < URING_BATCH_FILES; ++i) {
+        slot[i] = -1;
+    }
+    if (!ok || uring_register(writer->ring_fd, IORING_REGISTER_FILES, slot, URING_BATCH_FILES) != 0) {
+        uring_writer_close(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+static struct io_uring_sqe *next_request(UringWriter *writer, unsigned char opcode, unsigned request) {
+    //the requests are queued from the tail, which is published by uring_writer_submit()
+    unsigned ix = (*writer->sq_tail + writer->request_num++) & *writer->sq_mask;
+    struct io_uring_sqe *sqe = &writer->sqe[ix];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = (uint64_t)writer->file_num * FILE_REQUESTS + request;
+    writer->sq_array[ix] = ix;
+    return sqe;
+}
+
+int uring_writer_add(UringWriter *writer, const char *file_name, const unsigned char *data, unsigned size) {
+    if (writer->file_num == URING_BATCH_FILES || writer->failed) {
+        return 0;
+    }
+    unsigned slot = writer->file_num;
+    struct io_uring_sqe *sqe = next_request(writer, IORING_OP_OPENAT, OpenRequest);
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)file_name;
+    sqe->len = 0666;
+    //a slot isn't inherited by exec anyway (O_CLOEXEC is refused for slots)
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+    sqe->file_index = slot + 1;
+    sqe->flags = IOSQE_IO_LINK;
+    if (size > 0) {
+        //a short write breaks the chain
+        sqe = next_request(writer, IORING_OP_WRITE, WriteRequest);
+        sqe->fd = slot;
+        sqe->addr = (uint64_t)(uintptr_t)data;
+        sqe->len = size;
+        sqe->off = 0;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    }
+    sqe = next_request(writer, IORING_OP_CLOSE, CloseRequest);
+    sqe->file_index = slot + 1;
+    writer->size[slot] = size;
+    writer->result[slot] = 0;
+    ++writer->file_num;
+    return 1;
+}
+
+static unsigned reap_completions(UringWriter *writer) {
+    //returns the number of completions read
+    unsigned head = *writer->cq_head, cnt = 0;
+    unsigned tail = __atomic_load_n(writer->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head, ++cnt) {
+        const struct io_uring_cqe *cqe = &writer->cqe[head & *writer->cq_mask];
+        unsigned file_ix = (unsigned)(cqe->user_data / FILE_REQUESTS);
+        unsigned request = (unsigned)(cqe->user_data % FILE_REQUESTS);
+        int error = (cqe->res < 0) ? -cqe->res : 0;
+        if (request == WriteRequest && cqe->res >= 0 && (unsigned)cqe->res != writer->size[file_ix]) {
+            error = EIO;
+        }
+        //the failure of a chain is kept rather than the cancellation of the requests after it
+        if (error != 0 && (writer->result[file_ix] == 0 || writer->result[file_ix] == ECANCELED)) {
+            writer->result[file_ix] = error;
+        }
+    }
+    __atomic_store_n(writer->cq_head, head, __ATOMIC_RELEASE);
+    return cnt;
+}
+
+unsigned uring_writer_submit(UringWriter *writer, const int **result) {
+    unsigned to_submit = writer->request_num, pending = writer->request_num;
+    __atomic_store_n(writer->sq_tail, *writer->sq_tail + writer->request_num, __ATOMIC_RELEASE);
+    while (pending > 0) {
+        int ret = uring_enter(writer->ring_fd, to_submit, pending, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            break;
+        }
+        to_submit -= (ret > 0) ? (unsigned)ret : 0;
+        pending -= reap_completions(writer);
+    }
+    if (pending > 0) {
+        //the ring failed: the files without a result are reported as failed
+        writer->failed = 1;
+        for (unsigned i = 0; i < writer->file_num; ++i) {
+            writer->result[i] = (writer->result[i] != 0) ? writer->result[i] : EIO;
+        }
+    }
+    unsigned file_num = writer->file_num;
+    writer->file_num = 0;
+    writer->request_num = 0;
+    *result = writer->result;
+    return file_num;
+}
+
+void uring_writer_close(UringWriter *writer) {
+    if (writer == NULL) {
+        return;
+    }
+    //the registered slots are closed with the ring
+    if (writer->sqe != NULL) {
+        munmap(writer->sqe, writer->sqe_size);
+    }
+    if (writer->cq_ring != NULL && writer->cq_ring != writer->sq_ring) {
+        munmap(writer->cq_ring, writer->cq_ring_size);
+    }
+    if (writer->sq_ring != NULL) {
+        munmap(writer->sq_ring, writer->sq_ring_size);
+    }
+    close(writer->ring_fd);
+    free(writer);
+}
+
+#else
+
+//no io_uring: the files are written by stdio
+
+UringWriter *uring_writer_open(void) {
+    return NULL;
+}
+
+int uring_writer_add(UringWriter *writer, const char *file_name, const unsigned char *data, unsigned size) {
+    (void)writer;
+    (void)file_name;
+    (void)data;
+    (void)size;
+    return 0;
+}
+
+unsigned uring_writer_submit(UringWriter *writer, const int **result) {
+    (void)writer;
+    *result = NULL;
+    return 0;
+}
+
+void uring_writer_close(UringWriter *writer) {
+    (void)writer;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef URING_WRITER_H
+#define URING_WRITER_H
+
+//small files created, written & closed in batches through io_uring: a batch of files takes a few system calls
+//instead of three per file (Linux 6.0+; where io_uring isn't available the writer can't be opened)
+
+#define URING_BATCH_FILES 256
+
+typedef struct UringWriter UringWriter;
+
+//returns NULL if io_uring isn't available (the files are to be written by stdio then)
+
+UringWriter *uring_writer_open(void);
+
+//queue a file (truncated if it exists); the name & the data must stay valid until uring_writer_submit()
+//returns 0 if the batch is full or the ring failed
+
+int uring_writer_add(UringWriter *writer, const char *file_name, const unsigned char *data, unsigned size);
+
+//submit the queued files & wait for them; the i-th queued file's result is 0 or an errno value
+//(a file that failed may be left created or partially written); returns the number of files
+
+unsigned uring_writer_submit(UringWriter *writer, const int **result);
+
+void uring_writer_close(UringWriter *writer);
+
+#endif // URING_WRITER_H